@@ -0,0 +1,520 @@
+// Воспроизводимые замеры производительности поисковой системы.
+// Запуск: search_server_benchmark [--scenario=имя,...] [--runs=N] [--warmup=N] [--list]
+// Результаты выводятся в stdout в формате TSV, по строке на операцию сценария.
+// Размеры сценариев можно переопределить: --documents=N, --vocabulary=N, --queries=N,
+// --distinct-queries=N, --query-words=MIN-MAX.
+// С --write-corpus=путь корпус и журнал запросов единственного выбранного
+// сценария записываются в файлы путь и путь.queries без замеров
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "concurrent_search_server.h"
+#include "document.h"
+#include "generator.h"
+#include "metrics.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "string_processing.h"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace {
+
+// Параметры сценария замеров
+struct Scenario {
+    std::string name;
+    Generator::CorpusOptions corpus;
+    int document_count;
+    Generator::QueryLogOptions queries;
+    int query_count;
+    // Доля документов, удаляемых в замере удаления
+    double remove_share;
+    PostingFormat posting_format;
+};
+
+Generator::CorpusOptions MakeCorpusOptions(int vocabulary_size, double zipf_exponent, int median_document_words,
+    double document_words_sigma, double duplicate_share, double banned_share) {
+    Generator::CorpusOptions options;
+    options.vocabulary_size = vocabulary_size;
+    options.zipf_exponent = zipf_exponent;
+    options.median_document_words = median_document_words;
+    options.document_words_sigma = document_words_sigma;
+    options.duplicate_share = duplicate_share;
+    options.banned_share = banned_share;
+    return options;
+}
+
+Generator::QueryLogOptions MakeQueryLogOptions(int distinct_queries, double popularity_exponent, int min_query_words,
+    int max_query_words, double minus_prob) {
+    Generator::QueryLogOptions options;
+    options.distinct_queries = distinct_queries;
+    options.popularity_exponent = popularity_exponent;
+    options.min_query_words = min_query_words;
+    options.max_query_words = max_query_words;
+    options.minus_prob = minus_prob;
+    return options;
+}
+
+const std::vector<Scenario>& GetScenarios() {
+    static const std::vector<Scenario> scenarios = {
+        // Former Benchmark() of the tests: long uniform queries over a small vocabulary
+        { "baseline"s, MakeCorpusOptions(1'000, 0.0, 70, 0.0, 0.1, 0.0), 10'000,
+            MakeQueryLogOptions(100, 0.0, 70, 70, 0.0), 100, 0.1, PostingFormat::FLAT },
+        // Short hot queries over a skewed vocabulary, as in real traffic
+        { "zipf"s, MakeCorpusOptions(20'000, 1.0, 60, 0.6, 0.1, 0.1), 30'000,
+            MakeQueryLogOptions(500, 1.0, 1, 4, 0.1), 2'000, 0.1, PostingFormat::FLAT },
+        { "zipf_compressed"s, MakeCorpusOptions(20'000, 1.0, 60, 0.6, 0.1, 0.1), 30'000,
+            MakeQueryLogOptions(500, 1.0, 1, 4, 0.1), 2'000, 0.1, PostingFormat::COMPRESSED },
+        { "long_queries"s, MakeCorpusOptions(5'000, 0.8, 100, 0.8, 0.1, 0.1), 20'000,
+            MakeQueryLogOptions(200, 0.5, 10, 30, 0.3), 200, 0.1, PostingFormat::FLAT },
+    };
+    return scenarios;
+}
+
+// Dedup builds a word map per document, so it runs on a prefix of the corpus
+constexpr size_t MAX_DEDUP_DOCUMENTS = 5'000;
+// Queries per FindTopDocumentsBatch call, as in ProcessQueries
+constexpr size_t SEARCH_BATCH_SIZE = 64;
+
+struct Corpus {
+    std::vector<std::string> dictionary;
+    std::vector<Generator::GeneratedDocument> generated;
+    // Texts point into generated
+    std::vector<DocumentToAdd> documents;
+    std::vector<std::string> queries;
+};
+
+Corpus GenerateCorpus(const Scenario& scenario) {
+    Generator::CorpusGenerator generator(scenario.corpus);
+    Corpus corpus;
+    corpus.dictionary = generator.GetDictionary();
+    corpus.generated = generator.Generate(scenario.document_count);
+    corpus.documents.reserve(corpus.generated.size());
+    for (const auto& document : corpus.generated) {
+        corpus.documents.push_back({ document.id, document.text, document.status, document.ratings });
+    }
+    corpus.queries = Generator::GenerateQueryLog(generator, scenario.queries, scenario.query_count);
+    return corpus;
+}
+
+// Writes the corpus and the query log of the scenario to path and path.queries
+void WriteScenario(const Scenario& scenario, const std::string& path) {
+    Generator::CorpusGenerator generator(scenario.corpus);
+    std::ofstream corpus_out(path);
+    std::ofstream queries_out(path + ".queries"s);
+    if (!corpus_out || !queries_out) {
+        throw std::runtime_error("Cannot create "s + path);
+    }
+    Generator::WriteCorpus(generator, scenario.document_count, corpus_out);
+    Generator::WriteQueryLog(generator, scenario.queries, scenario.query_count, queries_out);
+    if (!corpus_out.flush() || !queries_out.flush()) {
+        throw std::runtime_error("Cannot write "s + path);
+    }
+}
+
+using Clock = std::chrono::steady_clock;
+
+// Measurements of one run of an operation
+struct Sample {
+    double seconds = 0;
+    size_t items = 0;
+    uint64_t checksum = 0;
+    // Latency of every item, or of the whole run for batch operations
+    LatencyHistogram latencies;
+};
+
+template <typename Function>
+uint64_t TimeNanoseconds(Function function) {
+    const auto start = Clock::now();
+    function();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+template <typename Function>
+void TimeItem(Sample& sample, Function function) {
+    const uint64_t nanoseconds = TimeNanoseconds(function);
+    sample.seconds += nanoseconds / 1e9;
+    ++sample.items;
+    sample.latencies.Add(nanoseconds);
+}
+
+template <typename Function>
+void TimeBatch(Sample& sample, size_t items, Function function) {
+    const uint64_t nanoseconds = TimeNanoseconds(function);
+    sample.seconds += nanoseconds / 1e9;
+    sample.items += items;
+    sample.latencies.Add(nanoseconds);
+}
+
+struct Options {
+    std::vector<std::string> scenarios;
+    int runs = 3;
+    int warmup = 1;
+    // Path to write the corpus of the only selected scenario to instead of measuring
+    std::string write_corpus;
+    // Overrides of the scenario parameters, zero keeps the ones of the scenario
+    int documents = 0;
+    int vocabulary = 0;
+    int queries = 0;
+    int distinct_queries = 0;
+    int min_query_words = 0;
+    int max_query_words = 0;
+};
+
+// The scenarios named in the options, all if none is, with the overrides applied.
+// Throws invalid_argument for an unknown name or inconsistent overrides
+std::vector<Scenario> SelectScenarios(const Options& options) {
+    const auto& scenarios = GetScenarios();
+    for (const std::string& name : options.scenarios) {
+        if (std::none_of(scenarios.begin(), scenarios.end(), [&name](const Scenario& scenario) {
+                return scenario.name == name;
+            })) {
+            throw std::invalid_argument("Unknown scenario: "s + name);
+        }
+    }
+    std::vector<Scenario> selected;
+    for (Scenario scenario : scenarios) {
+        if (!options.scenarios.empty()
+            && std::find(options.scenarios.begin(), options.scenarios.end(), scenario.name) == options.scenarios.end()) {
+            continue;
+        }
+        const auto override = [](auto& parameter, int value) {
+            if (value > 0) {
+                parameter = value;
+            }
+        };
+        override(scenario.document_count, options.documents);
+        override(scenario.corpus.vocabulary_size, options.vocabulary);
+        override(scenario.query_count, options.queries);
+        override(scenario.queries.distinct_queries, options.distinct_queries);
+        override(scenario.queries.min_query_words, options.min_query_words);
+        override(scenario.queries.max_query_words, options.max_query_words);
+        if (scenario.queries.min_query_words > scenario.queries.max_query_words) {
+            throw std::invalid_argument("Query word range is empty for scenario "s + scenario.name);
+        }
+        selected.push_back(std::move(scenario));
+    }
+    return selected;
+}
+
+class Reporter {
+public:
+    Reporter(std::ostream& out, const Options& options)
+        : out_(out)
+        , options_(options) {
+        out_ << "scenario\toperation\truns\titems\tmedian_ms\tthroughput_per_s\tmean_us\tp50_us\tp99_us\tp999_us"
+                "\tmax_us\tchecksum\tindex_kib\tpeak_rss_kib\n"sv;
+    }
+
+    // Runs the operation warmup + runs times and reports the measured runs
+    template <typename Run>
+    void Measure(const Scenario& scenario, std::string_view operation, size_t index_memory, Run run) {
+        std::vector<double> run_seconds;
+        LatencyHistogram latencies;
+        size_t items = 0;
+        uint64_t checksum = 0;
+        for (int i = 0; i < options_.warmup + options_.runs; ++i) {
+            Sample sample;
+            run(sample);
+            if (i < options_.warmup) {
+                continue;
+            }
+            run_seconds.push_back(sample.seconds);
+            latencies.Merge(sample.latencies);
+            items = sample.items;
+            checksum = sample.checksum;
+        }
+        std::sort(run_seconds.begin(), run_seconds.end());
+        const double median = run_seconds.empty() ? 0 : run_seconds[run_seconds.size() / 2];
+
+        const auto microseconds = [](uint64_t nanoseconds) {
+            return nanoseconds / 1e3;
+        };
+        out_ << scenario.name << '\t' << operation << '\t' << run_seconds.size() << '\t' << items << '\t'
+             << median * 1e3 << '\t' << (median > 0 ? items / median : 0) << '\t'
+             << (latencies.GetCount() > 0 ? microseconds(latencies.GetTotal() / latencies.GetCount()) : 0) << '\t'
+             << microseconds(latencies.GetPercentile(0.5)) << '\t' << microseconds(latencies.GetPercentile(0.99))
+             << '\t' << microseconds(latencies.GetPercentile(0.999)) << '\t' << microseconds(latencies.GetMax())
+             << '\t' << checksum << '\t' << index_memory / 1024 << '\t' << GetPeakRss() << std::endl;
+    }
+
+private:
+    // Peak resident memory of the whole process so far, in KiB
+    static long GetPeakRss() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    std::ostream& out_;
+    const Options& options_;
+};
+
+uint64_t Checksum(const std::vector<Document>& documents) {
+    uint64_t checksum = 0;
+    for (const Document& document : documents) {
+        checksum += static_cast<uint64_t>(document.id) + 1;
+    }
+    return checksum;
+}
+
+void RunScenario(const Scenario& scenario, Reporter& reporter) {
+    const Corpus corpus = GenerateCorpus(scenario);
+    // The most frequent word
+    const std::string& stop_words = corpus.dictionary[0];
+    const auto build_server = [&](size_t document_count) {
+        SearchServer search_server(stop_words, scenario.posting_format);
+        search_server.AddDocuments(std::execution::par,
+            { corpus.documents.begin(), corpus.documents.begin() + document_count });
+        search_server.WaitForIndexMerges();
+        return search_server;
+    };
+
+    const SearchServer search_server = build_server(corpus.documents.size());
+    const size_t index_memory = search_server.GetIndexMemoryUsage();
+
+    size_t corpus_bytes = 0;
+    for (const DocumentToAdd& document : corpus.documents) {
+        corpus_bytes += document.text.size();
+    }
+    // Items are bytes here, so the throughput is in bytes per second
+    for (const auto& [tokenizer, operation] : { std::pair{ Tokenizer::SCALAR, "tokenize_scalar"sv },
+             std::pair{ Tokenizer::SSE2, "tokenize_sse2"sv }, std::pair{ Tokenizer::AVX2, "tokenize_avx2"sv } }) {
+        if (!IsTokenizerSupported(tokenizer)) {
+            continue;
+        }
+        reporter.Measure(scenario, operation, index_memory, [&](Sample& sample) {
+            std::vector<std::string_view> words;
+            TimeBatch(sample, corpus_bytes, [&] {
+                for (const DocumentToAdd& document : corpus.documents) {
+                    SplitIntoWords(tokenizer, document.text, words);
+                    sample.checksum += words.size();
+                }
+            });
+        });
+    }
+    reporter.Measure(scenario, "ingest"sv, index_memory, [&](Sample& sample) {
+        SearchServer search_server(stop_words, scenario.posting_format);
+        for (const DocumentToAdd& document : corpus.documents) {
+            TimeItem(sample, [&] {
+                search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            });
+        }
+        sample.checksum = search_server.GetDocumentCount();
+    });
+    // Nobody reads while documents are added, so the versions are published once at the end
+    reporter.Measure(scenario, "ingest_concurrent"sv, index_memory, [&](Sample& sample) {
+        ConcurrentSearchServer search_server(SearchServer(stop_words, scenario.posting_format));
+        for (const DocumentToAdd& document : corpus.documents) {
+            TimeItem(sample, [&] {
+                search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            });
+        }
+        sample.checksum = search_server.GetDocumentCount();
+    });
+    // A reader takes every version, so every document is published
+    reporter.Measure(scenario, "ingest_concurrent_read"sv, index_memory, [&](Sample& sample) {
+        ConcurrentSearchServer search_server(SearchServer(stop_words, scenario.posting_format));
+        for (const DocumentToAdd& document : corpus.documents) {
+            TimeItem(sample, [&] {
+                search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+                search_server.GetVersion();
+            });
+        }
+        sample.checksum = search_server.GetDocumentCount();
+    });
+    reporter.Measure(scenario, "ingest_batch"sv, index_memory, [&](Sample& sample) {
+        SearchServer search_server(stop_words, scenario.posting_format);
+        TimeBatch(sample, corpus.documents.size(), [&] {
+            search_server.AddDocuments(std::execution::par, corpus.documents);
+        });
+        sample.checksum = search_server.GetDocumentCount();
+    });
+    reporter.Measure(scenario, "search"sv, index_memory, [&](Sample& sample) {
+        for (const std::string& query : corpus.queries) {
+            TimeItem(sample, [&] {
+                sample.checksum += Checksum(search_server.FindTopDocuments(query));
+            });
+        }
+    });
+    std::vector<SearchServer::PreparedQuery> prepared_queries;
+    for (const std::string& query : corpus.queries) {
+        prepared_queries.push_back(search_server.PrepareQuery(query));
+    }
+    reporter.Measure(scenario, "search_prepared"sv, index_memory, [&](Sample& sample) {
+        for (const auto& query : prepared_queries) {
+            TimeItem(sample, [&] {
+                sample.checksum += Checksum(search_server.FindTopDocuments(query));
+            });
+        }
+    });
+    reporter.Measure(scenario, "search_par"sv, index_memory, [&](Sample& sample) {
+        for (const std::string& query : corpus.queries) {
+            TimeItem(sample, [&] {
+                sample.checksum += Checksum(search_server.FindTopDocuments(std::execution::par, query));
+            });
+        }
+    });
+    reporter.Measure(scenario, "search_max_score"sv, index_memory, [&](Sample& sample) {
+        SearchOptions options;
+        options.evaluation = QueryEvaluation::MAX_SCORE;
+        for (const std::string& query : corpus.queries) {
+            TimeItem(sample, [&] {
+                sample.checksum += Checksum(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options));
+            });
+        }
+    });
+    // Batches of the size ProcessQueries uses, on the calling thread only, to compare with search
+    reporter.Measure(scenario, "search_batch"sv, index_memory, [&](Sample& sample) {
+        for (size_t begin = 0; begin < corpus.queries.size(); begin += SEARCH_BATCH_SIZE) {
+            const std::vector<std::string_view> batch(corpus.queries.begin() + begin,
+                corpus.queries.begin() + std::min(corpus.queries.size(), begin + SEARCH_BATCH_SIZE));
+            TimeBatch(sample, batch.size(), [&] {
+                for (const auto& documents : search_server.FindTopDocumentsBatch(batch)) {
+                    sample.checksum += Checksum(documents);
+                }
+            });
+        }
+    });
+    reporter.Measure(scenario, "process_queries"sv, index_memory, [&](Sample& sample) {
+        TimeBatch(sample, corpus.queries.size(), [&] {
+            for (const auto& documents : ProcessQueries(search_server, corpus.queries)) {
+                sample.checksum += Checksum(documents);
+            }
+        });
+    });
+    reporter.Measure(scenario, "match"sv, index_memory, [&](Sample& sample) {
+        for (size_t i = 0; i < corpus.queries.size(); ++i) {
+            const int document_id = corpus.documents[i * 7919 % corpus.documents.size()].id;
+            TimeItem(sample, [&] {
+                const auto [words, status] = search_server.MatchDocument(corpus.queries[i], document_id);
+                sample.checksum += words.size();
+            });
+        }
+    });
+    reporter.Measure(scenario, "remove"sv, index_memory, [&](Sample& sample) {
+        SearchServer copy(search_server);
+        const size_t remove_count = static_cast<size_t>(corpus.documents.size() * scenario.remove_share);
+        for (size_t i = 0; i < remove_count; ++i) {
+            TimeItem(sample, [&] {
+                copy.RemoveDocument(corpus.documents[i].id);
+            });
+        }
+        sample.checksum = copy.GetDocumentCount();
+    });
+    reporter.Measure(scenario, "dedup"sv, index_memory, [&](Sample& sample) {
+        const size_t document_count = std::min(corpus.documents.size(), MAX_DEDUP_DOCUMENTS);
+        SearchServer dedup_server = build_server(document_count);
+        std::ostream discarded(nullptr);
+        TimeBatch(sample, document_count, [&] {
+            RemoveDuplicates(dedup_server, discarded);
+        });
+        sample.checksum = dedup_server.GetDocumentCount();
+    });
+}
+
+void PrintUsage(std::ostream& out) {
+    out << "Usage: search_server_benchmark [--scenario=name,...] [--runs=N] [--warmup=N] [--list] [overrides]\n"
+           "       search_server_benchmark --scenario=name --write-corpus=path [overrides]\n"
+           "Overrides: [--documents=N] [--vocabulary=N] [--queries=N] [--distinct-queries=N] [--query-words=MIN-MAX]\n"
+           "Scenarios:"sv;
+    for (const Scenario& scenario : GetScenarios()) {
+        out << ' ' << scenario.name;
+    }
+    out << '\n';
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument = argv[i];
+        const auto value = [argument](std::string_view key) {
+            return argument.substr(key.size());
+        };
+        try {
+            if (argument == "--list"sv) {
+                for (const Scenario& scenario : GetScenarios()) {
+                    std::cout << scenario.name << '\n';
+                }
+                return 0;
+            } else if (argument.substr(0, 11) == "--scenario="sv) {
+                std::istringstream names{ std::string(value("--scenario="sv)) };
+                for (std::string name; std::getline(names, name, ',');) {
+                    options.scenarios.push_back(name);
+                }
+            } else if (argument.substr(0, 7) == "--runs="sv) {
+                options.runs = std::stoi(std::string(value("--runs="sv)));
+            } else if (argument.substr(0, 9) == "--warmup="sv) {
+                options.warmup = std::stoi(std::string(value("--warmup="sv)));
+            } else if (argument.substr(0, 15) == "--write-corpus="sv) {
+                options.write_corpus = std::string(value("--write-corpus="sv));
+            } else if (argument.substr(0, 12) == "--documents="sv) {
+                options.documents = std::stoi(std::string(value("--documents="sv)));
+            } else if (argument.substr(0, 13) == "--vocabulary="sv) {
+                options.vocabulary = std::stoi(std::string(value("--vocabulary="sv)));
+            } else if (argument.substr(0, 10) == "--queries="sv) {
+                options.queries = std::stoi(std::string(value("--queries="sv)));
+            } else if (argument.substr(0, 19) == "--distinct-queries="sv) {
+                options.distinct_queries = std::stoi(std::string(value("--distinct-queries="sv)));
+            } else if (argument.substr(0, 14) == "--query-words="sv) {
+                const std::string range(value("--query-words="sv));
+                const size_t dash = range.find('-');
+                options.min_query_words = std::stoi(range.substr(0, dash));
+                options.max_query_words = dash == std::string::npos
+                    ? options.min_query_words : std::stoi(range.substr(dash + 1));
+            } else {
+                PrintUsage(std::cerr);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+    }
+    if (options.runs < 1 || options.warmup < 0 || options.documents < 0 || options.vocabulary < 0
+        || options.queries < 0 || options.distinct_queries < 0 || options.min_query_words < 0
+        || (!options.write_corpus.empty() && options.scenarios.size() != 1)) {
+        PrintUsage(std::cerr);
+        return 1;
+    }
+    std::vector<Scenario> scenarios;
+    try {
+        scenarios = SelectScenarios(options);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << '\n';
+        PrintUsage(std::cerr);
+        return 1;
+    }
+
+    if (!options.write_corpus.empty()) {
+        try {
+            WriteScenario(scenarios.front(), options.write_corpus);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    Reporter reporter(std::cout, options);
+    for (const Scenario& scenario : scenarios) {
+        RunScenario(scenario, reporter);
+    }
+    return 0;
+}
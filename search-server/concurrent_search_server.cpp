@@ -0,0 +1,83 @@
+#include <execution>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "concurrent_search_server.h"
+
+ConcurrentSearchServer::ConcurrentSearchServer(const SearchServer& search_server)
+    : working_(std::make_unique<SearchServer>(search_server)) {
+    Publish();
+}
+
+std::future<std::vector<Document>> ConcurrentSearchServer::FindTopDocumentsAsync(std::string_view raw_query,
+    DocumentStatus status, const SearchOptions& options) const {
+    auto version = GetVersion();
+    const auto& executor = version->GetQueryExecutor();
+    return executor->Async([version = std::move(version), query = std::string(raw_query), status, options] {
+        return version->FindTopDocuments(std::execution::par, query, status, options);
+    });
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    Update([&](SearchServer& search_server) {
+        search_server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    Update([&documents](SearchServer& search_server) {
+        search_server.AddDocuments(std::execution::par, documents);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Update([document_id](SearchServer& search_server) {
+        search_server.RemoveDocument(document_id);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    Update([&document_ids](SearchServer& search_server) {
+        search_server.RemoveDocuments(document_ids);
+    });
+}
+
+void ConcurrentSearchServer::Update(const std::function<void(SearchServer&)>& update) {
+    std::lock_guard guard(write_guard_);
+    try {
+        update(*working_);
+    } catch (...) {
+        Commit();
+        throw;
+    }
+    Commit();
+}
+
+void ConcurrentSearchServer::Publish() const {
+    std::shared_ptr<const SearchServer> version = std::make_shared<const SearchServer>(*working_);
+    std::atomic_store_explicit(&version_, std::move(version), std::memory_order_release);
+    is_stale_.store(false);
+    is_read_.store(false);
+}
+
+void ConcurrentSearchServer::Commit() {
+    if (is_read_.load()) {
+        Publish();
+    } else {
+        is_stale_.store(true);
+    }
+}
+
+void ConcurrentSearchServer::PublishStale() const {
+    std::lock_guard guard(write_guard_);
+    // Another reader may have published them while this one waited
+    if (is_stale_.load()) {
+        Publish();
+    }
+}
@@ -0,0 +1,91 @@
+// Обьявление поисковой системы, в которой запросы выполняются одновременно с изменениями
+#pragma once
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Multi-version wrapper of SearchServer. Writers change a private working
+// copy and then publish an immutable copy of it; a reader pins the version
+// published when it starts. The version stays valid and unchanged for as
+// long as the query runs, and it is freed when its last reader releases it.
+// So queries never wait for writers and writers never wait for queries.
+//
+// Versions share posting lists, documents and terms with the working copy
+// (see PodBuffer), the append-only term dictionary, and the pages and chunks
+// of the per-term counts and the document ids. So a publish costs about the
+// number of terms in the mutable segment plus one pointer per page or chunk,
+// and a change copies only the pages and chunks it touches. Update applies
+// several changes with one publish.
+//
+// Publishes are coalesced. A writer publishes right away only if a reader
+// has taken the current version since the last publish; otherwise it only
+// marks the version stale, and the next reader publishes it. So a run of
+// changes nobody reads in between costs one publish, and the working copy
+// shares no pages with versions it would have to copy on the next change.
+// A reader finding the version stale while a change is being applied waits
+// for that change; with readers active the writers publish themselves, so
+// this happens only to the first reader after a run of unread changes.
+class ConcurrentSearchServer {
+public:
+    explicit ConcurrentSearchServer(const SearchServer& search_server);
+
+    // Версия поисковой системы со всеми завершенными изменениями, не меняется, пока на нее есть ссылка
+    std::shared_ptr<const SearchServer> GetVersion() const {
+        if (is_stale_.load()) {
+            PublishStale();
+        }
+        is_read_.store(true);
+        return std::atomic_load_explicit(&version_, std::memory_order_acquire);
+    }
+
+    // Поиск по текущей версии
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const {
+        return GetVersion()->FindTopDocuments(std::forward<Args>(args)...);
+    }
+
+    // Асинхронный поиск по текущей версии, версия не освобождается до завершения поиска
+    std::future<std::vector<Document>> FindTopDocumentsAsync(std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+
+    int GetDocumentCount() const {
+        return GetVersion()->GetDocumentCount();
+    }
+
+    // Изменение видно всем запросам, начатым после возврата из метода
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
+    void RemoveDocument(int document_id);
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Несколько изменений, которые станут видны запросам одновременно.
+    // Если update выбросит исключение, сделанные до него изменения тоже публикуются
+    void Update(const std::function<void(SearchServer&)>& update);
+
+private:
+    // Must be called with write_guard_ held
+    void Publish() const;
+    // Publishes the changes made since the last publish if a reader has taken that version,
+    // otherwise leaves them for the next reader. Must be called with write_guard_ held
+    void Commit();
+    // Publishes the changes left by Commit
+    void PublishStale() const;
+
+    mutable std::mutex write_guard_;
+    std::unique_ptr<SearchServer> working_;
+    // Accessed only through atomic_load and atomic_store
+    mutable std::shared_ptr<const SearchServer> version_;
+    // The working copy has changes version_ lacks
+    mutable std::atomic<bool> is_stale_ = false;
+    // A reader has taken version_ since it was published
+    mutable std::atomic<bool> is_read_ = false;
+};
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <optional>
+
+#include "document_id_map.h"
+
+bool DocumentIdMap::Insert(int id, DocOrdinal ordinal) {
+    if (chunks_.empty()) {
+        chunks_.push_back(std::make_shared<Chunk>(Chunk{ { id }, { ordinal } }));
+        ++size_;
+        return true;
+    }
+    // An id greater than all goes to the last chunk
+    const size_t chunk_index = std::min(FindChunk(id), chunks_.size() - 1);
+    const Chunk& shared_chunk = *chunks_[chunk_index];
+    const auto position = std::lower_bound(shared_chunk.ids.begin(), shared_chunk.ids.end(), id)
+        - shared_chunk.ids.begin();
+    if (position < static_cast<std::ptrdiff_t>(shared_chunk.ids.size()) && shared_chunk.ids[position] == id) {
+        return false;
+    }
+    Chunk& chunk = MutableChunk(chunk_index);
+    chunk.ids.insert(chunk.ids.begin() + position, id);
+    chunk.ordinals.insert(chunk.ordinals.begin() + position, ordinal);
+    ++size_;
+
+    if (chunk.ids.size() > MAX_CHUNK_SIZE) {
+        auto upper = std::make_shared<Chunk>();
+        // Ids mostly grow, so the last chunk is split off full
+        const bool is_appended = chunk_index + 1 == chunks_.size()
+            && position + 1 == static_cast<std::ptrdiff_t>(chunk.ids.size());
+        const size_t half = is_appended ? chunk.ids.size() - 1 : chunk.ids.size() / 2;
+        upper->ids.assign(chunk.ids.begin() + half, chunk.ids.end());
+        upper->ordinals.assign(chunk.ordinals.begin() + half, chunk.ordinals.end());
+        chunk.ids.resize(half);
+        chunk.ordinals.resize(half);
+        chunks_.insert(chunks_.begin() + chunk_index + 1, std::move(upper));
+    }
+    return true;
+}
+
+bool DocumentIdMap::Erase(int id) {
+    const size_t chunk_index = FindChunk(id);
+    if (chunk_index == chunks_.size()) {
+        return false;
+    }
+    const Chunk& shared_chunk = *chunks_[chunk_index];
+    const auto it = std::lower_bound(shared_chunk.ids.begin(), shared_chunk.ids.end(), id);
+    if (it == shared_chunk.ids.end() || *it != id) {
+        return false;
+    }
+    const auto position = it - shared_chunk.ids.begin();
+    if (shared_chunk.ids.size() == 1) {
+        chunks_.erase(chunks_.begin() + chunk_index);
+    } else {
+        Chunk& chunk = MutableChunk(chunk_index);
+        chunk.ids.erase(chunk.ids.begin() + position);
+        chunk.ordinals.erase(chunk.ordinals.begin() + position);
+    }
+    --size_;
+    return true;
+}
+
+std::optional<DocOrdinal> DocumentIdMap::Find(int id) const {
+    const size_t chunk_index = FindChunk(id);
+    if (chunk_index == chunks_.size()) {
+        return std::nullopt;
+    }
+    const Chunk& chunk = *chunks_[chunk_index];
+    const auto it = std::lower_bound(chunk.ids.begin(), chunk.ids.end(), id);
+    if (*it != id) {
+        return std::nullopt;
+    }
+    return chunk.ordinals[it - chunk.ids.begin()];
+}
+
+size_t DocumentIdMap::FindChunk(int id) const {
+    return std::partition_point(chunks_.begin(), chunks_.end(), [id](const std::shared_ptr<Chunk>& chunk) {
+        return chunk->ids.back() < id;
+    }) - chunks_.begin();
+}
+
+DocumentIdMap::Chunk& DocumentIdMap::MutableChunk(size_t chunk) {
+    std::shared_ptr<Chunk>& pointer = chunks_[chunk];
+    if (pointer.use_count() == 1) {
+        // Other owners are gone, their reads happened before they released the chunk
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } else {
+        pointer = std::make_shared<Chunk>(*pointer);
+    }
+    return *pointer;
+}
@@ -0,0 +1,123 @@
+// Обьявление отображения id документов в их внутренние номера
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "inverted_index.h"
+
+// Document id -> ordinal, iterated in the order of ids. The pairs are kept in
+// sorted chunks of at most MAX_CHUNK_SIZE, found by binary search over the
+// last ids of the chunks. Copies share the chunks, and a change copies only
+// the chunk it lands in if another copy shares it, so a copy costs one
+// pointer per chunk instead of one node per document.
+class DocumentIdMap {
+public:
+    class Iterator;
+
+    static constexpr size_t MAX_CHUNK_SIZE = 512;
+
+    // Returns false if the id is already present
+    bool Insert(int id, DocOrdinal ordinal);
+    // Returns false if there is no such id
+    bool Erase(int id);
+
+    std::optional<DocOrdinal> Find(int id) const;
+
+    bool Contains(int id) const {
+        return Find(id).has_value();
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    // Calls action(id, ordinal) for every id in increasing order
+    template <typename Action>
+    void ForEach(Action action) const {
+        for (const auto& chunk : chunks_) {
+            for (size_t i = 0; i < chunk->ids.size(); ++i) {
+                action(chunk->ids[i], chunk->ordinals[i]);
+            }
+        }
+    }
+
+private:
+    struct Chunk {
+        std::vector<int> ids;
+        std::vector<DocOrdinal> ordinals;
+    };
+
+    // First chunk whose last id is not less than the id, chunks_.size() if there is none
+    size_t FindChunk(int id) const;
+    // Copies the chunk before returning it for modification if another copy shares it
+    Chunk& MutableChunk(size_t chunk);
+
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+    size_t size_ = 0;
+};
+
+// Forward iterator over the ids, invalidated by any change of the map
+class DocumentIdMap::Iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int*;
+    using reference = const int&;
+
+    Iterator() = default;
+
+    reference operator*() const {
+        return (*chunk_)->ids[position_];
+    }
+
+    pointer operator->() const {
+        return &**this;
+    }
+
+    Iterator& operator++() {
+        if (++position_ == (*chunk_)->ids.size()) {
+            ++chunk_;
+            position_ = 0;
+        }
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        Iterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const Iterator& other) const {
+        return chunk_ == other.chunk_ && position_ == other.position_;
+    }
+
+    bool operator!=(const Iterator& other) const {
+        return !(*this == other);
+    }
+
+private:
+    friend class DocumentIdMap;
+
+    explicit Iterator(const std::shared_ptr<Chunk>* chunk)
+        : chunk_(chunk) {
+    }
+
+    const std::shared_ptr<Chunk>* chunk_ = nullptr;
+    size_t position_ = 0;
+};
+
+inline DocumentIdMap::Iterator DocumentIdMap::begin() const {
+    return Iterator(chunks_.data());
+}
+
+inline DocumentIdMap::Iterator DocumentIdMap::end() const {
+    return Iterator(chunks_.data() + chunks_.size());
+}
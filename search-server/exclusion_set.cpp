@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "exclusion_set.h"
+
+void ExclusionSet::Reset(DocOrdinal begin, DocOrdinal end, size_t expected_count,
+    const uint64_t* deleted, DocOrdinal deleted_begin) {
+    deleted_ = deleted;
+    deleted_begin_ = deleted_begin;
+    begin_ = begin;
+    empty_ = true;
+    bits_.clear();
+    documents_.clear();
+    const size_t word_count = (static_cast<size_t>(end - begin) + 63) / 64;
+    // A bitset word costs as much as two array entries
+    is_dense_ = word_count <= expected_count * 2;
+    if (is_dense_) {
+        bits_.assign(word_count, 0);
+    } else {
+        documents_.reserve(expected_count);
+    }
+}
+
+void ExclusionSet::Seal() {
+    if (!is_dense_) {
+        std::sort(documents_.begin(), documents_.end());
+        documents_.erase(std::unique(documents_.begin(), documents_.end()), documents_.end());
+    }
+}
+
+namespace {
+
+struct ExclusionSetSlot {
+    ExclusionSet excluded;
+    bool in_use = false;
+};
+
+thread_local ExclusionSetSlot thread_exclusion_set;
+
+} // namespace
+
+PooledExclusionSet::PooledExclusionSet() {
+    if (thread_exclusion_set.in_use) {
+        temporary_ = std::make_unique<ExclusionSet>();
+        excluded_ = temporary_.get();
+    } else {
+        thread_exclusion_set.in_use = true;
+        excluded_ = &thread_exclusion_set.excluded;
+    }
+}
+
+PooledExclusionSet::~PooledExclusionSet() {
+    if (!temporary_) {
+        thread_exclusion_set.in_use = false;
+    }
+}
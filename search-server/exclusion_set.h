@@ -0,0 +1,89 @@
+// Обьявление множества документов, исключенных из результата минус-словами запроса
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "inverted_index.h"
+
+// Ordinals from [begin, end) excluded by the minus words of a query. Built
+// before scoring, so excluded documents are skipped instead of being scored
+// and erased afterwards. A bitset over the range when the minus words cover
+// it densely, otherwise a sorted array, so the memory never exceeds the
+// number of minus-word postings read to build it. Documents removed from the
+// segment being searched are excluded too, through its deletion bit set.
+class ExclusionSet {
+public:
+    // Prepares the set for at most expected_count documents from [begin, end).
+    // Bit i of deleted stands for ordinal deleted_begin + i, nullptr if none is deleted
+    void Reset(DocOrdinal begin, DocOrdinal end, size_t expected_count,
+        const uint64_t* deleted = nullptr, DocOrdinal deleted_begin = 0);
+
+    void Add(DocOrdinal document) {
+        if (is_dense_) {
+            const size_t offset = document - begin_;
+            bits_[offset / 64] |= uint64_t{ 1 } << (offset % 64);
+        } else {
+            documents_.push_back(document);
+        }
+        empty_ = false;
+    }
+
+    // Must be called after the last Add and before Contains
+    void Seal();
+
+    bool Contains(DocOrdinal document) const {
+        if (deleted_ != nullptr) {
+            const size_t offset = document - deleted_begin_;
+            if ((deleted_[offset / 64] >> (offset % 64)) & 1) {
+                return true;
+            }
+        }
+        if (empty_) {
+            return false;
+        }
+        if (is_dense_) {
+            const size_t offset = document - begin_;
+            return (bits_[offset / 64] >> (offset % 64)) & 1;
+        }
+        return std::binary_search(documents_.begin(), documents_.end(), document);
+    }
+
+    bool empty() const {
+        return empty_ && deleted_ == nullptr;
+    }
+
+private:
+    const uint64_t* deleted_ = nullptr;
+    DocOrdinal deleted_begin_ = 0;
+    DocOrdinal begin_ = 0;
+    bool is_dense_ = false;
+    bool empty_ = true;
+    std::vector<uint64_t> bits_;
+    std::vector<DocOrdinal> documents_;
+};
+
+// Exclusion set reused by all queries running on the current thread, so its
+// arrays keep their capacity between queries. If the thread's set is already
+// taken (nested query), a temporary one is used instead.
+class PooledExclusionSet {
+public:
+    PooledExclusionSet();
+    ~PooledExclusionSet();
+
+    PooledExclusionSet(const PooledExclusionSet&) = delete;
+    PooledExclusionSet& operator=(const PooledExclusionSet&) = delete;
+
+    ExclusionSet& operator*() const {
+        return *excluded_;
+    }
+
+    ExclusionSet* operator->() const {
+        return excluded_;
+    }
+
+private:
+    std::unique_ptr<ExclusionSet> temporary_;
+    ExclusionSet* excluded_;
+};
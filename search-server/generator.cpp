@@ -1,11 +1,19 @@
+#include "generator.h"
 #include "search_server.h"
 #include "log_duration.h"
+#include <algorithm>
+#include <cmath>
 #include <execution>
 #include <iostream>
 #include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+using namespace std::string_literals;
+
 namespace Generator {
     
 std::string GenerateWord(std::mt19937& generator, int max_length) {
@@ -13,7 +21,7 @@ std::string GenerateWord(std::mt19937& generator, int max_length) {
     std::string word;
     word.reserve(length);
     for (int i = 0; i < length; ++i) {
-        word.push_back(std::uniform_int_distribution(0, 26)(generator) + 'a');
+        word.push_back(static_cast<char>('a' + std::uniform_int_distribution(0, 25)(generator)));
     }
     return word;
 }
@@ -28,7 +36,7 @@ std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_co
     return words;
 }
 
-std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0) {
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob) {
     std::string query;
     for (int i = 0; i < word_count; ++i) {
         if (!query.empty()) {
@@ -42,6 +50,39 @@ std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string
     return query;
 }
 
+ZipfDistribution::ZipfDistribution(size_t size, double exponent) {
+    cumulative_.reserve(size);
+    double total = 0;
+    for (size_t rank = 0; rank < size; ++rank) {
+        total += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+        cumulative_.push_back(total);
+    }
+    for (double& weight : cumulative_) {
+        weight /= total;
+    }
+}
+
+size_t ZipfDistribution::operator()(std::mt19937& generator) const {
+    const double point = std::uniform_real_distribution<>(0, 1)(generator);
+    const auto it = std::upper_bound(cumulative_.begin(), cumulative_.end(), point);
+    return std::min<size_t>(it - cumulative_.begin(), cumulative_.size() - 1);
+}
+
+std::string GenerateText(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                         const ZipfDistribution& words, int word_count, double minus_prob) {
+    std::string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        if (minus_prob > 0 && std::uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            text.push_back('-');
+        }
+        text += dictionary[words(generator)];
+    }
+    return text;
+}
+
 std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, 
                         int query_count, int max_word_count) {
     std::vector<std::string> queries;
@@ -52,5 +93,202 @@ std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vec
     return queries;
 }
 
+namespace {
+
+// Distinct words, shorter ones first so that they get the higher frequencies
+std::vector<std::string> GenerateDistinctWords(std::mt19937& generator, int word_count, int max_length) {
+    if (word_count <= 0 || max_length <= 0) {
+        throw std::invalid_argument("Vocabulary size and word length must be positive"s);
+    }
+    double possible_words = 0;
+    for (int length = 1; length <= max_length && possible_words < 2.0 * word_count; ++length) {
+        possible_words += std::pow(26.0, length);
+    }
+    // Random words of the last lengths are only drawn slowly, so half of them at most
+    if (possible_words / 2 < word_count) {
+        throw std::invalid_argument("Vocabulary size is too large for the word length"s);
+    }
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> words;
+    words.reserve(word_count);
+    while (words.size() < static_cast<size_t>(word_count)) {
+        std::string word = GenerateWord(generator, max_length);
+        if (seen.insert(word).second) {
+            words.push_back(std::move(word));
+        }
+    }
+    std::stable_sort(words.begin(), words.end(), [](const std::string& lhs, const std::string& rhs) {
+        return lhs.size() < rhs.size();
+    });
+    return words;
+}
+
+// Distinct queries of a log, picked by their popularity
+class HotQueries {
+public:
+    HotQueries(const CorpusGenerator& corpus, const QueryLogOptions& options)
+        : generator_(options.seed)
+        , popularity_(std::max(options.distinct_queries, 1), options.popularity_exponent) {
+        if (options.distinct_queries <= 0 || options.min_query_words <= 0
+            || options.max_query_words < options.min_query_words) {
+            throw std::invalid_argument("Invalid query log options"s);
+        }
+        std::uniform_int_distribution<int> word_count(options.min_query_words, options.max_query_words);
+        queries_.reserve(options.distinct_queries);
+        for (int i = 0; i < options.distinct_queries; ++i) {
+            queries_.push_back(GenerateText(generator_, corpus.GetDictionary(), corpus.GetWordDistribution(),
+                word_count(generator_), options.minus_prob));
+        }
+    }
+
+    const std::string& Next() {
+        return queries_[popularity_(generator_)];
+    }
+
+private:
+    std::mt19937 generator_;
+    ZipfDistribution popularity_;
+    std::vector<std::string> queries_;
+};
+
+} // namespace
+
+CorpusGenerator::CorpusGenerator(const CorpusOptions& options)
+    : options_(options)
+    , generator_(options.seed)
+    , dictionary_(GenerateDistinctWords(generator_, options.vocabulary_size, options.max_word_length))
+    , words_(dictionary_.size(), options.zipf_exponent) {
+    if (options.median_document_words <= 0 || options.max_document_words <= 0 || options.document_words_sigma < 0
+        || options.duplicate_share < 0 || options.duplicate_share > 1
+        || options.banned_share < 0 || options.banned_share > 1) {
+        throw std::invalid_argument("Invalid corpus options"s);
+    }
+}
+
+GeneratedDocument CorpusGenerator::Next() {
+    GeneratedDocument document;
+    document.id = next_id_++;
+    std::uniform_real_distribution<> share(0, 1);
+    document.status = share(generator_) < options_.banned_share ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+    const int rating_count = std::uniform_int_distribution(1, 5)(generator_);
+    for (int i = 0; i < rating_count; ++i) {
+        document.ratings.push_back(std::uniform_int_distribution(-10, 10)(generator_));
+    }
+
+    if (!duplicate_sources_.empty() && share(generator_) < options_.duplicate_share) {
+        std::vector<uint32_t> words = duplicate_sources_[
+            std::uniform_int_distribution<size_t>(0, duplicate_sources_.size() - 1)(generator_)];
+        std::shuffle(words.begin(), words.end(), generator_);
+        document.text = MakeText(words);
+        document.is_duplicate = true;
+        return document;
+    }
+
+    int word_count = options_.median_document_words;
+    if (options_.document_words_sigma > 0) {
+        std::lognormal_distribution<> length(std::log(options_.median_document_words), options_.document_words_sigma);
+        word_count = static_cast<int>(std::lround(std::min<double>(length(generator_), options_.max_document_words)));
+    }
+    word_count = std::clamp(word_count, 1, options_.max_document_words);
+    std::vector<uint32_t> words(word_count);
+    for (uint32_t& word : words) {
+        word = static_cast<uint32_t>(words_(generator_));
+    }
+    document.text = MakeText(words);
+    if (options_.duplicate_share > 0) {
+        if (duplicate_sources_.size() == MAX_DUPLICATE_SOURCES) {
+            duplicate_sources_.pop_front();
+        }
+        duplicate_sources_.push_back(std::move(words));
+    }
+    return document;
+}
+
+std::vector<GeneratedDocument> CorpusGenerator::Generate(size_t count) {
+    std::vector<GeneratedDocument> documents;
+    documents.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        documents.push_back(Next());
+    }
+    return documents;
+}
+
+std::string CorpusGenerator::MakeText(const std::vector<uint32_t>& words) const {
+    std::string text;
+    for (const uint32_t word : words) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        text += dictionary_[word];
+    }
+    return text;
+}
+
+std::vector<std::string> GenerateQueryLog(const CorpusGenerator& corpus, const QueryLogOptions& options,
+                                          size_t query_count) {
+    HotQueries hot_queries(corpus, options);
+    std::vector<std::string> queries;
+    queries.reserve(query_count);
+    for (size_t i = 0; i < query_count; ++i) {
+        queries.push_back(hot_queries.Next());
+    }
+    return queries;
+}
+
+void WriteQueryLog(const CorpusGenerator& corpus, const QueryLogOptions& options, size_t query_count,
+                   std::ostream& out) {
+    HotQueries hot_queries(corpus, options);
+    for (size_t i = 0; i < query_count; ++i) {
+        out << hot_queries.Next() << '\n';
+    }
+}
+
+void WriteCorpus(CorpusGenerator& corpus, size_t document_count, std::ostream& out) {
+    for (size_t i = 0; i < document_count; ++i) {
+        const GeneratedDocument document = corpus.Next();
+        out << document.id << '\t' << static_cast<int>(document.status) << '\t';
+        for (size_t j = 0; j < document.ratings.size(); ++j) {
+            if (j > 0) {
+                out << ',';
+            }
+            out << document.ratings[j];
+        }
+        out << '\t' << document.text << '\n';
+    }
+}
+
+bool ReadDocument(std::istream& in, GeneratedDocument& document) {
+    std::string line;
+    if (!std::getline(in, line)) {
+        return false;
+    }
+    std::istringstream fields(line);
+    std::string id;
+    std::string status;
+    std::string ratings;
+    if (!std::getline(fields, id, '\t') || !std::getline(fields, status, '\t') || !std::getline(fields, ratings, '\t')) {
+        throw std::invalid_argument("Invalid corpus line: "s + line);
+    }
+    std::getline(fields, document.text);
+    try {
+        document.id = std::stoi(id);
+        const int status_number = std::stoi(status);
+        if (status_number < static_cast<int>(DocumentStatus::ACTUAL)
+            || status_number > static_cast<int>(DocumentStatus::REMOVED)) {
+            throw std::invalid_argument("Invalid document status"s);
+        }
+        document.status = static_cast<DocumentStatus>(status_number);
+        document.ratings.clear();
+        std::istringstream rating_fields(ratings);
+        for (std::string rating; std::getline(rating_fields, rating, ',');) {
+            document.ratings.push_back(std::stoi(rating));
+        }
+    } catch (const std::logic_error&) {
+        throw std::invalid_argument("Invalid corpus line: "s + line);
+    }
+    document.is_duplicate = false;
+    return true;
+}
+
 } // namespace Generator
 
@@ -1,5 +1,8 @@
+#pragma once
 #include "search_server.h"
 #include "log_duration.h"
+#include <cstdint>
+#include <deque>
 #include <execution>
 #include <iostream>
 #include <random>
@@ -17,5 +20,115 @@ std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string
 
 std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, 
                                                                 int query_count, int max_word_count);
+
+// Распределение Ципфа на номерах [0, size): номер k выпадает с весом 1 / (k + 1)^exponent,
+// при exponent = 0 распределение равномерное
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t size, double exponent);
+
+    size_t operator()(std::mt19937& generator) const;
+
+private:
+    // Cumulative weights, normalized to end at 1
+    std::vector<double> cumulative_;
+};
+
+// Текст из word_count слов словаря, номера слов выбираются распределением words
+std::string GenerateText(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                         const ZipfDistribution& words, int word_count, double minus_prob = 0);
+
+// Параметры синтетического корпуса документов
+struct CorpusOptions {
+    int vocabulary_size = 10'000;
+    int max_word_length = 10;
+    // Показатель закона Ципфа для частот слов, 0 - все слова равновероятны
+    double zipf_exponent = 1.0;
+    // Длина документа в словах распределена логнормально с медианой median_document_words
+    // и параметром document_words_sigma, при 0 все документы одной длины
+    int median_document_words = 100;
+    double document_words_sigma = 0.5;
+    int max_document_words = 2'000;
+    // Доля документов, повторяющих слова одного из недавних документов в другом порядке
+    double duplicate_share = 0;
+    // Доля документов со статусом BANNED
+    double banned_share = 0;
+    unsigned seed = std::mt19937::default_seed;
+};
+
+// Документ синтетического корпуса
+struct GeneratedDocument {
+    int id = 0;
+    std::string text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    // Документ повторяет слова одного из предыдущих и будет удален RemoveDuplicates
+    bool is_duplicate = false;
+};
+
+// Потоковый генератор корпуса: документы создаются по одному, и занимаемая память
+// не зависит от их числа. Одинаковые параметры дают одинаковый корпус
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusOptions& options = {});
+
+    // Различные слова по убыванию частоты, более короткие слова встречаются чаще
+    const std::vector<std::string>& GetDictionary() const {
+        return dictionary_;
+    }
+
+    // Распределение номеров слов словаря в текстах
+    const ZipfDistribution& GetWordDistribution() const {
+        return words_;
+    }
+
+    // Следующий документ корпуса, id идут подряд с нуля
+    GeneratedDocument Next();
+    std::vector<GeneratedDocument> Generate(size_t count);
+
+private:
+    // Duplicates repeat one of this many latest original documents
+    static constexpr size_t MAX_DUPLICATE_SOURCES = 1024;
+
+    std::string MakeText(const std::vector<uint32_t>& words) const;
+
+    CorpusOptions options_;
+    std::mt19937 generator_;
+    std::vector<std::string> dictionary_;
+    ZipfDistribution words_;
+    // Word numbers of the latest original documents
+    std::deque<std::vector<uint32_t>> duplicate_sources_;
+    int next_id_ = 0;
+};
+
+// Параметры журнала запросов
+struct QueryLogOptions {
+    // Число различных запросов, их популярность следует закону Ципфа
+    // с показателем popularity_exponent, так что горячие запросы повторяются
+    int distinct_queries = 1'000;
+    double popularity_exponent = 1.0;
+    int min_query_words = 1;
+    int max_query_words = 4;
+    // Вероятность того, что слово запроса - минус-слово
+    double minus_prob = 0;
+    unsigned seed = std::mt19937::default_seed;
+};
+
+// Журнал из query_count запросов, слова выбираются с частотами слов корпуса
+std::vector<std::string> GenerateQueryLog(const CorpusGenerator& corpus, const QueryLogOptions& options,
+                                          size_t query_count);
+
+// Записывает журнал в out по запросу в строке, не храня его в памяти
+void WriteQueryLog(const CorpusGenerator& corpus, const QueryLogOptions& options, size_t query_count,
+                   std::ostream& out);
+
+// Записывает document_count следующих документов корпуса в out по документу в строке:
+// id, номер статуса, рейтинги через запятую и текст, разделенные табуляцией.
+// Корпус может быть больше доступной памяти
+void WriteCorpus(CorpusGenerator& corpus, size_t document_count, std::ostream& out);
+
+// Читает очередной документ, записанный WriteCorpus. Возвращает false в конце потока,
+// при неверном формате строки выбрасывает std::invalid_argument
+bool ReadDocument(std::istream& in, GeneratedDocument& document);
 } // namespace Generator
 
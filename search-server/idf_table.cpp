@@ -0,0 +1,38 @@
+#include <cmath>
+#include <mutex>
+
+#include "idf_table.h"
+
+IdfTable::IdfTable(const IdfTable& other) {
+    // A query may be refreshing the copied table
+    std::lock_guard guard(other.refresh_guard_);
+    dirty_.store(other.dirty_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    log_document_count_ = other.log_document_count_;
+    log_document_freqs_ = other.log_document_freqs_;
+    dirty_terms_ = other.dirty_terms_;
+    are_all_dirty_ = other.are_all_dirty_;
+}
+
+void IdfTable::RefreshSlow(const SegmentedIndex& index, size_t document_count) const {
+    std::lock_guard guard(refresh_guard_);
+    if (!dirty_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    log_document_count_ = document_count > 0 ? std::log(static_cast<double>(document_count)) : 0;
+    const auto refresh_term = [&](TermId term) {
+        const size_t document_freq = index.DocumentFreq(term);
+        log_document_freqs_.Mutable(term) = document_freq > 0 ? std::log(static_cast<double>(document_freq)) : 0;
+    };
+    if (are_all_dirty_) {
+        for (TermId term = 0; term < log_document_freqs_.size(); ++term) {
+            refresh_term(term);
+        }
+    } else {
+        for (const TermId term : dirty_terms_) {
+            refresh_term(term);
+        }
+    }
+    dirty_terms_.clear();
+    are_all_dirty_ = false;
+    dirty_.store(false, std::memory_order_release);
+}
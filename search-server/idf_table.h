@@ -0,0 +1,65 @@
+// Обьявление кеша обратной частоты документов (IDF) для слов индекса
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "pod_buffer.h"
+#include "segmented_index.h"
+#include "term_dictionary.h"
+
+// IDF of every term kept as log(document count) - log(document frequency).
+// Writers only mark what changed; the logarithms are recomputed lazily by the
+// first query after the changes, so a bulk ingest does not pay for them on
+// every insert. Copies share the pages of the logarithms (see PagedBuffer).
+class IdfTable {
+public:
+    IdfTable() = default;
+    IdfTable(const IdfTable& other);
+    IdfTable& operator=(const IdfTable&) = delete;
+
+    // Called when a document with the term was added or removed
+    void MarkTermChanged(TermId term) {
+        if (term >= log_document_freqs_.size()) {
+            log_document_freqs_.Grow(term + 1, 0);
+        }
+        // A term may be listed more than once; past the number of terms all of them are refreshed
+        if (!are_all_dirty_) {
+            if (dirty_terms_.size() < log_document_freqs_.size()) {
+                dirty_terms_.push_back(term);
+            } else {
+                are_all_dirty_ = true;
+                dirty_terms_.clear();
+            }
+        }
+        dirty_.store(true, std::memory_order_relaxed);
+    }
+
+    // Called when the number of documents changed
+    void MarkDocumentCountChanged() {
+        dirty_.store(true, std::memory_order_relaxed);
+    }
+
+    // Brings the cache up to date, safe to call from concurrent queries
+    void Refresh(const SegmentedIndex& index, size_t document_count) const {
+        if (dirty_.load(std::memory_order_acquire)) {
+            RefreshSlow(index, document_count);
+        }
+    }
+
+    // Valid after Refresh for terms with at least one document
+    double Get(TermId term) const {
+        return log_document_count_ - log_document_freqs_[term];
+    }
+
+private:
+    void RefreshSlow(const SegmentedIndex& index, size_t document_count) const;
+
+    mutable std::atomic<bool> dirty_ = false;
+    mutable std::mutex refresh_guard_;
+    mutable double log_document_count_ = 0;
+    mutable PagedBuffer<double> log_document_freqs_;
+    mutable std::vector<TermId> dirty_terms_;
+    mutable bool are_all_dirty_ = false;
+};
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "inverted_index.h"
+#include "snapshot.h"
+
+namespace {
+
+void WriteVarint(PodBuffer<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& bytes) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *bytes++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+// Reads a varint of at most 5 bytes ending before end, false if there is none
+bool ReadCheckedVarint(const uint8_t*& bytes, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && bytes != end; shift += 7) {
+        const uint8_t byte = *bytes++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsDeleted(const uint64_t* deleted, DocOrdinal deleted_begin, DocOrdinal document) {
+    if (deleted == nullptr) {
+        return false;
+    }
+    const size_t offset = document - deleted_begin;
+    return (deleted[offset / 64] >> (offset % 64)) & 1;
+}
+
+} // namespace
+
+void PostingList::Append(DocOrdinal document, uint32_t count, uint32_t document_length) {
+    const double term_freq = static_cast<double>(count) / document_length;
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+    ++size_;
+    if (format_ == PostingFormat::FLAT) {
+        doc_ids_.push_back(document);
+        term_freqs_.push_back(term_freq);
+        return;
+    }
+
+    if (blocks_.empty() || blocks_.back().size == BLOCK_SIZE) {
+        const DocOrdinal base = blocks_.empty() ? 0 : blocks_.back().last_document;
+        blocks_.push_back({ base, static_cast<uint32_t>(block_bytes_.size()), 0 });
+    }
+    BlockInfo& block = blocks_.MutableData()[blocks_.size() - 1];
+    WriteVarint(block_bytes_, document - block.last_document);
+    WriteVarint(block_bytes_, count);
+    WriteVarint(block_bytes_, document_length);
+    block.last_document = document;
+    ++block.size;
+}
+
+void PostingList::DecodeBlock(size_t block, DocOrdinal* documents, uint32_t* counts, uint32_t* lengths) const {
+    const BlockInfo& info = blocks_[block];
+    const uint8_t* bytes = block_bytes_.data() + info.offset;
+    DocOrdinal document = BlockBase(block);
+    for (uint32_t i = 0; i < info.size; ++i) {
+        document += ReadVarint(bytes);
+        const uint32_t count = ReadVarint(bytes);
+        const uint32_t length = ReadVarint(bytes);
+        documents[i] = document;
+        if (counts != nullptr) {
+            counts[i] = count;
+            lengths[i] = length;
+        }
+    }
+}
+
+void PostingList::AppendFrom(const PostingList& source, const uint64_t* deleted, DocOrdinal deleted_begin) {
+    if (format_ == PostingFormat::FLAT) {
+        for (size_t i = 0; i < source.size_; ++i) {
+            const DocOrdinal document = source.doc_ids_[i];
+            if (!IsDeleted(deleted, deleted_begin, document)) {
+                max_term_freq_ = std::max(max_term_freq_, source.term_freqs_[i]);
+                doc_ids_.push_back(document);
+                term_freqs_.push_back(source.term_freqs_[i]);
+                ++size_;
+            }
+        }
+        return;
+    }
+
+    std::array<DocOrdinal, BLOCK_SIZE> documents;
+    std::array<uint32_t, BLOCK_SIZE> counts;
+    std::array<uint32_t, BLOCK_SIZE> lengths;
+    for (size_t block = 0; block < source.blocks_.size(); ++block) {
+        source.DecodeBlock(block, documents.data(), counts.data(), lengths.data());
+        for (size_t i = 0; i < source.blocks_[block].size; ++i) {
+            if (!IsDeleted(deleted, deleted_begin, documents[i])) {
+                Append(documents[i], counts[i], lengths[i]);
+            }
+        }
+    }
+}
+
+bool PostingList::Contains(DocOrdinal document) const {
+    if (format_ == PostingFormat::FLAT) {
+        const auto it = std::lower_bound(doc_ids_.begin(), doc_ids_.end(), document);
+        return it != doc_ids_.end() && *it == document;
+    }
+
+    const size_t block = FindBlock(document);
+    if (block == blocks_.size()) {
+        return false;
+    }
+    std::array<DocOrdinal, BLOCK_SIZE> documents;
+    DecodeBlock(block, documents.data(), nullptr, nullptr);
+    const BlockInfo& info = blocks_[block];
+    const auto it = std::lower_bound(documents.begin(), documents.begin() + info.size, document);
+    return it != documents.begin() + info.size && *it == document;
+}
+
+void PostingList::ShrinkToFit() {
+    doc_ids_.shrink_to_fit();
+    term_freqs_.shrink_to_fit();
+    block_bytes_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+}
+
+size_t PostingList::MemoryUsage() const {
+    return doc_ids_.MemoryUsage() + term_freqs_.MemoryUsage() + block_bytes_.MemoryUsage() + blocks_.MemoryUsage();
+}
+
+void PostingList::Save(SnapshotWriter& writer) const {
+    writer.Write(static_cast<uint64_t>(size_));
+    writer.Write(max_term_freq_);
+    writer.WriteArray(doc_ids_);
+    writer.WriteArray(term_freqs_);
+    writer.WriteArray(block_bytes_);
+    writer.WriteArray(blocks_);
+}
+
+void PostingList::Load(SnapshotReader& reader, DocOrdinal begin, DocOrdinal end) {
+    size_ = reader.Read<uint64_t>();
+    max_term_freq_ = reader.Read<double>();
+    doc_ids_ = reader.ReadArray<DocOrdinal>();
+    term_freqs_ = reader.ReadArray<double>();
+    block_bytes_ = reader.ReadArray<uint8_t>();
+    blocks_ = reader.ReadArray<BlockInfo>();
+    const size_t stored_size = format_ == PostingFormat::FLAT ? doc_ids_.size()
+        : std::accumulate(blocks_.begin(), blocks_.end(), size_t{ 0 }, [](size_t size, const BlockInfo& block) {
+            return size + block.size;
+        });
+    if (stored_size != size_ || term_freqs_.size() != doc_ids_.size() || !IsValid(begin, end)) {
+        throw std::runtime_error("Snapshot is corrupted");
+    }
+}
+
+bool PostingList::IsValid(DocOrdinal begin, DocOrdinal end) const {
+    if (format_ == PostingFormat::FLAT) {
+        return doc_ids_.empty() || (doc_ids_[0] >= begin && doc_ids_[doc_ids_.size() - 1] < end
+            && std::adjacent_find(doc_ids_.begin(), doc_ids_.end(), std::greater_equal<>()) == doc_ids_.end());
+    }
+
+    // Blocks follow each other in the bytes, the first delta of the list is from ordinal 0
+    const uint8_t* bytes = block_bytes_.data();
+    const uint8_t* const bytes_end = bytes + block_bytes_.size();
+    DocOrdinal document = 0;
+    for (size_t block = 0; block < blocks_.size(); ++block) {
+        const BlockInfo& info = blocks_[block];
+        if (info.size == 0 || info.size > BLOCK_SIZE || info.offset != bytes - block_bytes_.data()) {
+            return false;
+        }
+        for (uint32_t i = 0; i < info.size; ++i) {
+            uint32_t delta = 0;
+            uint32_t count = 0;
+            uint32_t length = 0;
+            const bool is_first = block == 0 && i == 0;
+            if (!ReadCheckedVarint(bytes, bytes_end, delta) || !ReadCheckedVarint(bytes, bytes_end, count)
+                || !ReadCheckedVarint(bytes, bytes_end, length) || (delta == 0 && !is_first)
+                || uint64_t{ document } + delta >= end) {
+                return false;
+            }
+            document += delta;
+            if (is_first && document < begin) {
+                return false;
+            }
+        }
+        if (info.last_document != document) {
+            return false;
+        }
+    }
+    return bytes == bytes_end;
+}
+
+PostingList::Cursor::Cursor(const PostingList& list)
+    : list_(&list) {
+    if (list.format_ == PostingFormat::FLAT) {
+        documents_ = list.doc_ids_.data();
+        term_freqs_ = list.term_freqs_.data();
+        size_ = list.doc_ids_.size();
+    } else if (!LoadBlock(0)) {
+        LoadNextBlock();
+    }
+}
+
+PostingList::Cursor& PostingList::Cursor::operator=(const Cursor& other) {
+    list_ = other.list_;
+    block_ = other.block_;
+    position_ = other.position_;
+    size_ = other.size_;
+    buffered_ = other.buffered_;
+    if (buffered_) {
+        std::copy(other.block_documents_.begin(), other.block_documents_.begin() + size_, block_documents_.begin());
+        std::copy(other.block_term_freqs_.begin(), other.block_term_freqs_.begin() + size_, block_term_freqs_.begin());
+        documents_ = block_documents_.data();
+        term_freqs_ = block_term_freqs_.data();
+    } else {
+        documents_ = other.documents_;
+        term_freqs_ = other.term_freqs_;
+    }
+    return *this;
+}
+
+bool PostingList::Cursor::LoadBlock(size_t block) {
+    block_ = block;
+    position_ = 0;
+    if (block >= list_->blocks_.size()) {
+        size_ = 0;
+        return false;
+    }
+    std::array<uint32_t, BLOCK_SIZE> counts;
+    std::array<uint32_t, BLOCK_SIZE> lengths;
+    list_->DecodeBlock(block, block_documents_.data(), counts.data(), lengths.data());
+    const BlockInfo& info = list_->blocks_[block];
+    for (size_t i = 0; i < info.size; ++i) {
+        block_term_freqs_[i] = static_cast<double>(counts[i]) / lengths[i];
+    }
+    buffered_ = true;
+    documents_ = block_documents_.data();
+    term_freqs_ = block_term_freqs_.data();
+    size_ = info.size;
+    return size_ > 0;
+}
+
+void PostingList::Cursor::LoadNextBlock() {
+    if (!buffered_) {
+        // A flat list is a single block
+        position_ = size_ = 0;
+        return;
+    }
+    while (block_ < list_->blocks_.size()) {
+        if (LoadBlock(block_ + 1)) {
+            return;
+        }
+    }
+}
+
+void PostingList::Cursor::SeekGEQ(DocOrdinal document) {
+    if (AtEnd()) {
+        return;
+    }
+    if (buffered_ && list_->blocks_[block_].last_document < document) {
+        // Skip entries point to the block which may contain the ordinal
+        const auto it = std::lower_bound(list_->blocks_.begin() + block_ + 1, list_->blocks_.end(), document,
+            [](const BlockInfo& block, DocOrdinal value) {
+                return block.last_document < value;
+            });
+        if (!LoadBlock(it - list_->blocks_.begin())) {
+            return;
+        }
+    }
+    position_ = std::lower_bound(documents_ + position_, documents_ + size_, document) - documents_;
+    if (position_ == size_) {
+        LoadNextBlock();
+    }
+}
+
+void InvertedIndex::Add(TermId term, DocOrdinal document, uint32_t count, uint32_t document_length) {
+    if ((terms_.size() + 1) * 2 > slots_.size()) {
+        Rehash(std::max<size_t>(16, slots_.size() * 2));
+    }
+    const size_t slot = FindSlot(term);
+    uint32_t list = slots_[slot];
+    if (list == EMPTY_SLOT) {
+        list = static_cast<uint32_t>(terms_.size());
+        slots_.MutableData()[slot] = list;
+        terms_.push_back(term);
+        if (list % LIST_PAGE_SIZE == 0) {
+            list_pages_.push_back(std::make_shared<std::vector<PostingList>>());
+            list_pages_.back()->reserve(LIST_PAGE_SIZE);
+        }
+        MutablePage(list / LIST_PAGE_SIZE).emplace_back(format_);
+    }
+    MutablePage(list / LIST_PAGE_SIZE)[list % LIST_PAGE_SIZE].Append(document, count, document_length);
+    ++posting_count_;
+}
+
+std::vector<PostingList>& InvertedIndex::MutablePage(size_t page) {
+    auto& lists = list_pages_[page];
+    if (lists.use_count() == 1) {
+        // Other owners are gone, their reads happened before they released the page
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } else {
+        auto copy = std::make_shared<std::vector<PostingList>>();
+        copy->reserve(LIST_PAGE_SIZE);
+        copy->assign(lists->begin(), lists->end());
+        lists = std::move(copy);
+    }
+    return *lists;
+}
+
+void InvertedIndex::Rehash(size_t capacity) {
+    PodBuffer<uint32_t> slots;
+    slots.resize(capacity);
+    std::fill(slots.MutableData(), slots.MutableData() + capacity, EMPTY_SLOT);
+    slots_ = std::move(slots);
+    uint32_t* slot_data = slots_.MutableData();
+    for (uint32_t list = 0; list < terms_.size(); ++list) {
+        slot_data[FindSlot(terms_[list])] = list;
+    }
+}
+
+size_t InvertedIndex::MemoryUsage() const {
+    size_t bytes = terms_.MemoryUsage() + slots_.MemoryUsage();
+    for (const auto& page : list_pages_) {
+        bytes += page->capacity() * sizeof(PostingList);
+        for (const PostingList& list : *page) {
+            bytes += list.MemoryUsage();
+        }
+    }
+    return bytes;
+}
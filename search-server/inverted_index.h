@@ -0,0 +1,252 @@
+// Обьявление инвертированного индекса: для каждого слова отсортированный список документов
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "pod_buffer.h"
+#include "term_dictionary.h"
+
+// Internal dense number of a document, assigned in the order documents are added
+using DocOrdinal = uint32_t;
+
+// Способ хранения списков документов слова
+enum class PostingFormat {
+    // Массивы номеров документов и частот слова, самый быстрый поиск
+    FLAT,
+    // Блоки со сжатыми разностями номеров документов, меньше памяти
+    COMPRESSED,
+};
+
+// Postings of one term sorted by document ordinal.
+//
+// FLAT keeps them as structure of arrays.
+//
+// COMPRESSED packs them into blocks of BLOCK_SIZE postings: the ordinal delta,
+// the occurrence count of the term and the document length as varints. Every
+// block has a skip entry with its last ordinal, so seeking decodes only the
+// block it lands in.
+//
+// Lists are never changed in the middle: removed documents are marked by the
+// segment holding the list and dropped when segments are merged.
+//
+// Term frequency is count / length in both formats, so they score equally.
+class PostingList {
+public:
+    class Cursor;
+
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    explicit PostingList(PostingFormat format = PostingFormat::FLAT)
+        : format_(format) {
+    }
+
+    // The ordinal must be greater than every ordinal already in the list.
+    // Term occurs count times among document_length words of the document
+    void Append(DocOrdinal document, uint32_t count, uint32_t document_length);
+
+    // Appends the postings of a list of the same format, skipping the documents
+    // marked in deleted: bit i stands for ordinal deleted_begin + i, nullptr skips none
+    void AppendFrom(const PostingList& source, const uint64_t* deleted, DocOrdinal deleted_begin);
+
+    bool Contains(DocOrdinal document) const;
+
+    size_t size() const {
+        return size_;
+    }
+
+    // Upper bound of the term frequency over the list, used to skip documents
+    // that cannot get into the top results
+    double MaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    // Releases the capacity reserved for appending
+    void ShrinkToFit();
+
+    // Bytes taken by the postings
+    size_t MemoryUsage() const;
+
+    void Save(SnapshotWriter& writer) const;
+    // Postings stay in the mapped snapshot until the list is changed. They are
+    // checked to be sorted ordinals in [begin, end), runtime_error is thrown otherwise
+    void Load(SnapshotReader& reader, DocOrdinal begin, DocOrdinal end);
+
+    Cursor begin() const;
+
+private:
+    struct BlockInfo {
+        // Last ordinal of the block, the delta base of the next block
+        DocOrdinal last_document;
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // Ordinal the deltas of the block start from
+    DocOrdinal BlockBase(size_t block) const {
+        return block == 0 ? 0 : blocks_[block - 1].last_document;
+    }
+
+    // Whether the loaded postings are sorted ordinals in [begin, end) and every
+    // compressed block decodes within its bytes
+    bool IsValid(DocOrdinal begin, DocOrdinal end) const;
+
+    // Decodes the block, counts and lengths may be nullptr if not needed
+    void DecodeBlock(size_t block, DocOrdinal* documents, uint32_t* counts, uint32_t* lengths) const;
+
+    // Block which may contain the ordinal, blocks_.size() if there is none
+    size_t FindBlock(DocOrdinal document) const {
+        return std::lower_bound(blocks_.begin(), blocks_.end(), document,
+            [](const BlockInfo& block, DocOrdinal value) {
+                return block.last_document < value;
+            }) - blocks_.begin();
+    }
+
+    PostingFormat format_;
+    size_t size_ = 0;
+    double max_term_freq_ = 0;
+
+    // FLAT
+    PodBuffer<DocOrdinal> doc_ids_;
+    PodBuffer<double> term_freqs_;
+
+    // COMPRESSED
+    PodBuffer<uint8_t> block_bytes_;
+    PodBuffer<BlockInfo> blocks_;
+};
+
+// Forward iterator over postings with skipping to a given ordinal.
+// For compressed lists it decodes one block at a time into its own buffer.
+class PostingList::Cursor {
+public:
+    explicit Cursor(const PostingList& list);
+
+    Cursor(const Cursor& other) {
+        *this = other;
+    }
+
+    Cursor& operator=(const Cursor& other);
+
+    bool AtEnd() const {
+        return position_ == size_;
+    }
+
+    DocOrdinal Document() const {
+        return documents_[position_];
+    }
+
+    double TermFreq() const {
+        return term_freqs_[position_];
+    }
+
+    void Next() {
+        if (++position_ == size_) {
+            LoadNextBlock();
+        }
+    }
+
+    // Moves to the first posting with ordinal not less than the given one
+    void SeekGEQ(DocOrdinal document);
+
+private:
+
+    // Makes the block current, returns false if it has no postings
+    bool LoadBlock(size_t block);
+    // Moves to the next block with postings or to the end
+    void LoadNextBlock();
+
+    const PostingList* list_;
+    size_t block_ = 0;
+    size_t position_ = 0;
+    size_t size_ = 0;
+    const DocOrdinal* documents_ = nullptr;
+    const double* term_freqs_ = nullptr;
+
+    bool buffered_ = false;
+    std::array<DocOrdinal, BLOCK_SIZE> block_documents_;
+    std::array<double, BLOCK_SIZE> block_term_freqs_;
+};
+
+inline PostingList::Cursor PostingList::begin() const {
+    return Cursor(*this);
+}
+
+// Term id -> posting list of the documents added last. It is the mutable
+// segment of SegmentedIndex, so it holds few of the dictionary terms: lists
+// are numbered densely in the order their terms first occur, and a small
+// open-addressing table maps a term id to its list. Memory follows the number
+// of terms in the segment, not the dictionary size.
+//
+// Lists are kept in pages of LIST_PAGE_SIZE shared by copies, and appending
+// to a list copies its page first if another copy shares it. So a copy costs
+// one pointer per page, and the next change of the original copies only the
+// pages of the terms it adds postings to.
+class InvertedIndex {
+public:
+    explicit InvertedIndex(PostingFormat format = PostingFormat::FLAT)
+        : format_(format) {
+    }
+
+    void Add(TermId term, DocOrdinal document, uint32_t count, uint32_t document_length);
+
+    // Returns nullptr if the term has no postings
+    const PostingList* Find(TermId term) const {
+        if (slots_.empty()) {
+            return nullptr;
+        }
+        const uint32_t list = slots_[FindSlot(term)];
+        return list == EMPTY_SLOT ? nullptr : &GetList(list);
+    }
+
+    PostingFormat GetFormat() const {
+        return format_;
+    }
+
+    // Count of postings of all terms
+    size_t PostingCount() const {
+        return posting_count_;
+    }
+
+    // Bytes taken by all posting lists
+    size_t MemoryUsage() const;
+
+private:
+    // Copies the lists when the index becomes immutable
+    friend class Segment;
+
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+    static constexpr size_t LIST_PAGE_SIZE = 16;
+
+    const PostingList& GetList(uint32_t list) const {
+        return (*list_pages_[list / LIST_PAGE_SIZE])[list % LIST_PAGE_SIZE];
+    }
+
+    // Copies the page before returning it for modification if another copy shares it
+    std::vector<PostingList>& MutablePage(size_t page);
+
+    static size_t Hash(TermId term) {
+        return static_cast<size_t>(term) * 0x9E3779B97F4A7C15ull >> 16;
+    }
+
+    // Slot holding the list of the term, or the empty slot where it would go
+    size_t FindSlot(TermId term) const {
+        const size_t mask = slots_.size() - 1;
+        size_t slot = Hash(term) & mask;
+        while (slots_[slot] != EMPTY_SLOT && terms_[slots_[slot]] != term) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void Rehash(size_t capacity);
+
+    PostingFormat format_;
+    // Term and posting list by list number
+    PodBuffer<TermId> terms_;
+    std::vector<std::shared_ptr<std::vector<PostingList>>> list_pages_;
+    // List numbers, EMPTY_SLOT in free slots, at most half of them are taken
+    PodBuffer<uint32_t> slots_;
+    size_t posting_count_ = 0;
+};
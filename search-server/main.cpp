@@ -9,7 +9,7 @@
 #include <string>
 #include <vector>
 
-int main(int argc, char *argv[]) {
+int main(int argc, char*[]) {
     if(argc < 2) {
         /* Создается экзмепляр класса с конструктором, принимающий строку стоп слов. */
         SearchServer search_server("and with"s);
@@ -26,27 +26,26 @@ int main(int argc, char *argv[]) {
             search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, {1, 2});
         }
         std::cout << "ACTUAL by default:"s << std::endl;
-        /* Последовательная версия.
+        /* Последовательная версия. */
         /* Выводим только актуальные документы. */
         for (const Document& document : search_server.FindTopDocuments("curly nasty cat"s)) {
             std::cout << document << std::endl;
         }
         std::cout << "BANNED:"s << std::endl;
-        /* Последовательная версия.
+        /* Последовательная версия. */
         /* Только заблокированные документы. */
         for (const Document& document : search_server.FindTopDocuments(std::execution::seq, "curly nasty cat"s, 
             DocumentStatus::BANNED)) {
             std::cout << document << std::endl;
         }
         std::cout << "Even ids:"s << std::endl;
-        /* Параллельная версия.
+        /* Параллельная версия. */
         /* Документы с четным id. */
         for (const Document& document : search_server.FindTopDocuments(std::execution::par, "curly nasty cat"s, 
-            [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; })) {
+            [](int document_id, DocumentStatus, int) { return document_id % 2 == 0; })) {
             std::cout << document << std::endl;
         }
     } else {
         TestSearchServer();
-        Benchmark();
     }
 }
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "metrics.h"
+
+using namespace std::string_view_literals;
+
+namespace {
+
+constexpr size_t STAGE_COUNT = static_cast<size_t>(MetricStage::COUNT);
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(MetricCounter::COUNT);
+
+// Written by its owner thread only, read by snapshots
+struct ThreadMetrics {
+    struct Stage {
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> buckets{};
+        std::atomic<uint64_t> total = 0;
+        std::atomic<uint64_t> max = 0;
+    };
+
+    std::array<Stage, STAGE_COUNT> stages;
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+};
+
+// The only writer may increment without a read-modify-write
+void Increase(std::atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& Get() {
+        // Never destroyed, threads may record while static objects are destroyed
+        static MetricsRegistry* registry = new MetricsRegistry;
+        return *registry;
+    }
+
+    ThreadMetrics* Acquire() {
+        std::lock_guard guard(mutex_);
+        if (!free_.empty()) {
+            ThreadMetrics* metrics = free_.back();
+            free_.pop_back();
+            return metrics;
+        }
+        all_.push_back(std::make_unique<ThreadMetrics>());
+        return all_.back().get();
+    }
+
+    // Measurements of a finished thread stay in its block
+    void Release(ThreadMetrics* metrics) {
+        std::lock_guard guard(mutex_);
+        free_.push_back(metrics);
+    }
+
+    template <typename Function>
+    void ForEach(Function function) {
+        std::lock_guard guard(mutex_);
+        for (const auto& metrics : all_) {
+            function(*metrics);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadMetrics>> all_;
+    std::vector<ThreadMetrics*> free_;
+};
+
+class ThreadMetricsHolder {
+public:
+    ThreadMetricsHolder()
+        : metrics_(MetricsRegistry::Get().Acquire()) {
+    }
+
+    ~ThreadMetricsHolder() {
+        MetricsRegistry::Get().Release(metrics_);
+    }
+
+    ThreadMetrics& Get() {
+        return *metrics_;
+    }
+
+private:
+    ThreadMetrics* metrics_;
+};
+
+ThreadMetrics& GetThreadMetrics() {
+    thread_local ThreadMetricsHolder holder;
+    return holder.Get();
+}
+
+} // namespace
+
+std::string_view GetMetricName(MetricStage stage) {
+    switch (stage) {
+    case MetricStage::QUERY_PARSE: return "query_parse"sv;
+    case MetricStage::QUERY_LOOKUP: return "query_lookup"sv;
+    case MetricStage::QUERY_MINUS_FILTER: return "query_minus_filter"sv;
+    case MetricStage::QUERY_SCORE: return "query_score"sv;
+    case MetricStage::QUERY_MATERIALIZE: return "query_materialize"sv;
+    case MetricStage::QUERY_TOP_K: return "query_top_k"sv;
+    case MetricStage::QUERY_SEARCH: return "query_search"sv;
+    case MetricStage::QUERY_BATCH: return "query_batch"sv;
+    case MetricStage::INGEST_TOKENIZE: return "ingest_tokenize"sv;
+    case MetricStage::INGEST_INDEX: return "ingest_index"sv;
+    case MetricStage::INGEST_DOCUMENT: return "ingest_document"sv;
+    case MetricStage::INGEST_BATCH: return "ingest_batch"sv;
+    case MetricStage::REMOVE_DOCUMENT: return "remove_document"sv;
+    case MetricStage::COUNT: break;
+    }
+    return "unknown"sv;
+}
+
+std::string_view GetMetricName(MetricCounter counter) {
+    switch (counter) {
+    case MetricCounter::QUERIES: return "queries"sv;
+    case MetricCounter::POSTINGS: return "postings"sv;
+    case MetricCounter::MATCHED_DOCUMENTS: return "matched_documents"sv;
+    case MetricCounter::ADDED_DOCUMENTS: return "added_documents"sv;
+    case MetricCounter::REMOVED_DOCUMENTS: return "removed_documents"sv;
+    case MetricCounter::COUNT: break;
+    }
+    return "unknown"sv;
+}
+
+void LatencyHistogram::Add(uint64_t value, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    buckets_[GetBucket(value)] += count;
+    count_ += count;
+    total_ += value * count;
+    max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::Add(const BucketCounts& bucket_counts, uint64_t total, uint64_t max) {
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        buckets_[bucket] += bucket_counts[bucket];
+        count_ += bucket_counts[bucket];
+    }
+    total_ += total;
+    max_ = std::max(max_, max);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        buckets_[bucket] += other.buckets_[bucket];
+    }
+    count_ += other.count_;
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::GetPercentile(double quantile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * count_)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += buckets_[bucket];
+        if (seen >= rank) {
+            return std::min(GetBucketMax(bucket), max_);
+        }
+    }
+    return max_;
+}
+
+void RecordMetric(MetricStage stage, uint64_t nanoseconds) {
+    auto& metrics = GetThreadMetrics().stages[static_cast<size_t>(stage)];
+    Increase(metrics.buckets[LatencyHistogram::GetBucket(nanoseconds)], 1);
+    Increase(metrics.total, nanoseconds);
+    if (nanoseconds > metrics.max.load(std::memory_order_relaxed)) {
+        metrics.max.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+void AddMetric(MetricCounter counter, uint64_t value) {
+    Increase(GetThreadMetrics().counters[static_cast<size_t>(counter)], value);
+}
+
+MetricsSnapshot GetMetricsSnapshot() {
+    MetricsSnapshot snapshot;
+    MetricsRegistry::Get().ForEach([&snapshot](const ThreadMetrics& metrics) {
+        for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+            const auto& recorded = metrics.stages[stage];
+            LatencyHistogram::BucketCounts bucket_counts;
+            for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+                bucket_counts[bucket] = recorded.buckets[bucket].load(std::memory_order_relaxed);
+            }
+            snapshot.stages[stage].Add(bucket_counts, recorded.total.load(std::memory_order_relaxed),
+                recorded.max.load(std::memory_order_relaxed));
+        }
+        for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+            snapshot.counters[counter] += metrics.counters[counter].load(std::memory_order_relaxed);
+        }
+    });
+    return snapshot;
+}
+
+void ResetMetrics() {
+    MetricsRegistry::Get().ForEach([](ThreadMetrics& metrics) {
+        for (auto& stage : metrics.stages) {
+            for (auto& bucket : stage.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            stage.total.store(0, std::memory_order_relaxed);
+            stage.max.store(0, std::memory_order_relaxed);
+        }
+        for (auto& counter : metrics.counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    });
+}
+
+void PrintMetrics(std::ostream& out, const MetricsSnapshot& snapshot) {
+    out << "stage\tcount\tmean_ns\tp50_ns\tp99_ns\tp999_ns\tmax_ns\n"sv;
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        const LatencyHistogram& histogram = snapshot.stages[stage];
+        if (histogram.GetCount() == 0) {
+            continue;
+        }
+        out << GetMetricName(static_cast<MetricStage>(stage)) << '\t' << histogram.GetCount() << '\t'
+            << histogram.GetTotal() / histogram.GetCount() << '\t' << histogram.GetPercentile(0.5) << '\t'
+            << histogram.GetPercentile(0.99) << '\t' << histogram.GetPercentile(0.999) << '\t'
+            << histogram.GetMax() << '\n';
+    }
+    out << "counter\tvalue\n"sv;
+    for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+        out << GetMetricName(static_cast<MetricCounter>(counter)) << '\t' << snapshot.counters[counter] << '\n';
+    }
+}
@@ -0,0 +1,176 @@
+// Обьявление счетчиков и гистограмм задержек этапов поиска и индексации
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// Этапы, длительность которых измеряется
+enum class MetricStage {
+    // Разбор запроса
+    QUERY_PARSE,
+    // Поиск списков документов слов запроса
+    QUERY_LOOKUP,
+    // Сбор документов с минус-словами
+    QUERY_MINUS_FILTER,
+    // Просмотр списков документов и подсчет релевантности
+    QUERY_SCORE,
+    // Заполнение результатов найденными документами
+    QUERY_MATERIALIZE,
+    // Выбор лучших документов
+    QUERY_TOP_K,
+    // Поиск по разобранному запросу целиком
+    QUERY_SEARCH,
+    // Пакетный поиск
+    QUERY_BATCH,
+    // Разбиение текста документа на слова
+    INGEST_TOKENIZE,
+    // Добавление слов документов в индекс
+    INGEST_INDEX,
+    // Добавление одного документа целиком
+    INGEST_DOCUMENT,
+    // Пакетное добавление целиком
+    INGEST_BATCH,
+    // Удаление документа
+    REMOVE_DOCUMENT,
+    COUNT,
+};
+
+// События, которые считаются
+enum class MetricCounter {
+    // Запросы, выполненные без кэша результатов
+    QUERIES,
+    // Документы в списках слов найденных запросов, верхняя граница просмотренных
+    POSTINGS,
+    // Документы, найденные полным перебором, до выбора лучших
+    MATCHED_DOCUMENTS,
+    ADDED_DOCUMENTS,
+    REMOVED_DOCUMENTS,
+    COUNT,
+};
+
+std::string_view GetMetricName(MetricStage stage);
+std::string_view GetMetricName(MetricCounter counter);
+
+// HDR-style histogram of nanoseconds: values below 2^SUB_BUCKET_BITS are
+// exact, every higher power of two is split into 2^SUB_BUCKET_BITS buckets,
+// so a bucket is within about 3% of the values it counts. Values are
+// clamped to 2^MAX_VALUE_BITS ns, about 18 minutes.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr int MAX_VALUE_BITS = 40;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t{ 1 } << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static size_t GetBucket(uint64_t value) {
+        value = std::min<uint64_t>(value, (uint64_t{ 1 } << MAX_VALUE_BITS) - 1);
+        if (value < SUB_BUCKET_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        const int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+        return static_cast<size_t>(shift) * SUB_BUCKET_COUNT + static_cast<size_t>(value >> shift);
+    }
+
+    // Largest value counted by the bucket
+    static uint64_t GetBucketMax(size_t bucket) {
+        if (bucket < SUB_BUCKET_COUNT) {
+            return bucket;
+        }
+        const size_t shift = bucket / SUB_BUCKET_COUNT - 1;
+        const uint64_t mantissa = bucket % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    using BucketCounts = std::array<uint64_t, BUCKET_COUNT>;
+
+    void Add(uint64_t value, uint64_t count = 1);
+    // Adds values counted elsewhere by bucket, with their exact total and maximum
+    void Add(const BucketCounts& bucket_counts, uint64_t total, uint64_t max);
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t GetCount() const {
+        return count_;
+    }
+
+    uint64_t GetTotal() const {
+        return total_;
+    }
+
+    uint64_t GetMax() const {
+        return max_;
+    }
+
+    // Значение, не меньше которого доля quantile всех значений, например 0.99 для p99
+    uint64_t GetPercentile(double quantile) const;
+
+private:
+    BucketCounts buckets_{};
+    uint64_t count_ = 0;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+};
+
+// Сумма измерений всех потоков на момент вызова GetMetricsSnapshot
+struct MetricsSnapshot {
+    std::array<LatencyHistogram, static_cast<size_t>(MetricStage::COUNT)> stages;
+    std::array<uint64_t, static_cast<size_t>(MetricCounter::COUNT)> counters{};
+
+    const LatencyHistogram& Get(MetricStage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+
+    uint64_t Get(MetricCounter counter) const {
+        return counters[static_cast<size_t>(counter)];
+    }
+};
+
+// Every thread records into its own block with plain relaxed stores, so
+// recording takes no lock and no read-modify-write. A snapshot sums the
+// blocks of all threads; blocks of finished threads are kept and reused.
+void RecordMetric(MetricStage stage, uint64_t nanoseconds);
+void AddMetric(MetricCounter counter, uint64_t value);
+
+MetricsSnapshot GetMetricsSnapshot();
+// Обнуляет измерения, сделанные одновременно с вызовом, могут потеряться
+void ResetMetrics();
+
+// Вывод в формате TSV: этап, число измерений, среднее, p50, p99, p999, максимум в наносекундах,
+// затем счетчики
+void PrintMetrics(std::ostream& out, const MetricsSnapshot& snapshot);
+
+// Records the lifetime of the object as the stage duration
+class StageTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StageTimer(MetricStage stage)
+        : stage_(stage) {
+    }
+
+    ~StageTimer() {
+        RecordMetric(stage_, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_).count()));
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    const MetricStage stage_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+// Сборка с -DSEARCH_SERVER_DISABLE_METRICS убирает все измерения из кода поиска и индексации
+#ifdef SEARCH_SERVER_DISABLE_METRICS
+#define METRIC_STAGE(stage)
+#define METRIC_COUNT(counter, value)
+#else
+#define METRIC_CONCAT_INTERNAL(X, Y) X ## Y
+#define METRIC_CONCAT(X, Y) METRIC_CONCAT_INTERNAL(X, Y)
+#define METRIC_STAGE(stage) StageTimer METRIC_CONCAT(stageTimer, __LINE__)(MetricStage::stage)
+#define METRIC_COUNT(counter, value) AddMetric(MetricCounter::counter, (value))
+#endif
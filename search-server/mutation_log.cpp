@@ -0,0 +1,337 @@
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mutation_log.h"
+#include "snapshot.h"
+
+using namespace std::string_literals;
+
+namespace {
+
+constexpr char LOG_MAGIC[8] = { 'S', 'R', 'C', 'H', 'W', 'A', 'L', 0 };
+constexpr uint32_t LOG_VERSION = 1;
+// Magic, version and a reserved word
+constexpr size_t HEADER_SIZE = sizeof(LOG_MAGIC) + 2 * sizeof(uint32_t);
+// Every record starts with the size and the CRC-32 of its body
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+const std::array<uint32_t, 256> CRC_TABLE = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+uint32_t Crc32(const char* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = CRC_TABLE[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+template <typename T>
+void Put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Bounds-checked reading of a record body
+class BodyReader {
+public:
+    BodyReader(const char* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    template <typename T>
+    bool Get(T& value) {
+        if (size_ - position_ < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data_ + position_, sizeof(T));
+        position_ += sizeof(T);
+        return true;
+    }
+
+    bool GetText(uint32_t size, std::string_view& text) {
+        if (size_ - position_ < size) {
+            return false;
+        }
+        text = { data_ + position_, size };
+        position_ += size;
+        return true;
+    }
+
+    bool AtEnd() const {
+        return position_ == size_;
+    }
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t position_ = 0;
+};
+
+bool DecodeRecord(const char* data, size_t size, MutationLog::Record& record) {
+    BodyReader body(data, size);
+    uint8_t type = 0;
+    if (!body.Get(record.sequence) || !body.Get(type) || !body.Get(record.document_id)) {
+        return false;
+    }
+    record.type = static_cast<MutationLog::RecordType>(type);
+    if (record.type == MutationLog::RecordType::REMOVE_DOCUMENT) {
+        return body.AtEnd();
+    }
+    if (record.type != MutationLog::RecordType::ADD_DOCUMENT) {
+        return false;
+    }
+    uint8_t status = 0;
+    uint32_t rating_count = 0;
+    if (!body.Get(status) || status > static_cast<uint8_t>(DocumentStatus::REMOVED) || !body.Get(rating_count)
+        || rating_count > size / sizeof(int)) {
+        return false;
+    }
+    record.status = static_cast<DocumentStatus>(status);
+    record.ratings.resize(rating_count);
+    for (int& rating : record.ratings) {
+        if (!body.Get(rating)) {
+            return false;
+        }
+    }
+    uint32_t text_size = 0;
+    return body.Get(text_size) && body.GetText(text_size, record.text) && body.AtEnd();
+}
+
+std::string EncodeRecord(const std::string& body) {
+    std::string record;
+    record.reserve(RECORD_HEADER_SIZE + body.size());
+    Put(record, static_cast<uint32_t>(body.size()));
+    Put(record, Crc32(body.data(), body.size()));
+    record += body;
+    return record;
+}
+
+bool WriteAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+} // namespace
+
+MutationLog::MutationLog(const std::string& path, uint64_t valid_size, const MutationLogOptions& options)
+    : path_(path)
+    , options_(options) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open mutation log "s + path);
+    }
+    bool is_opened = true;
+    if (valid_size < HEADER_SIZE) {
+        std::string header(LOG_MAGIC, sizeof(LOG_MAGIC));
+        Put(header, LOG_VERSION);
+        Put(header, uint32_t{ 0 });
+        is_opened = ftruncate(fd_, 0) == 0 && WriteAll(fd_, header);
+    } else {
+        is_opened = ftruncate(fd_, static_cast<off_t>(valid_size)) == 0;
+    }
+    if (!is_opened || fdatasync(fd_) != 0) {
+        close(fd_);
+        throw std::runtime_error("Cannot prepare mutation log "s + path);
+    }
+    writer_ = std::thread([this] {
+        WriteLoop();
+    });
+}
+
+MutationLog::~MutationLog() {
+    {
+        std::lock_guard guard(mutex_);
+        stop_ = true;
+    }
+    has_records_.notify_one();
+    writer_.join();
+    close(fd_);
+}
+
+void MutationLog::AppendAddDocument(uint64_t sequence, int document_id, std::string_view document,
+    DocumentStatus status, const std::vector<int>& ratings) {
+    std::string body;
+    body.reserve(32 + ratings.size() * sizeof(int) + document.size());
+    Put(body, sequence);
+    Put(body, static_cast<uint8_t>(RecordType::ADD_DOCUMENT));
+    Put(body, document_id);
+    Put(body, static_cast<uint8_t>(status));
+    Put(body, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        Put(body, rating);
+    }
+    Put(body, static_cast<uint32_t>(document.size()));
+    body += document;
+    Append(EncodeRecord(body));
+}
+
+void MutationLog::AppendRemoveDocument(uint64_t sequence, int document_id) {
+    std::string body;
+    Put(body, sequence);
+    Put(body, static_cast<uint8_t>(RecordType::REMOVE_DOCUMENT));
+    Put(body, document_id);
+    Append(EncodeRecord(body));
+}
+
+void MutationLog::Append(std::string_view record) {
+    {
+        std::lock_guard guard(mutex_);
+        CheckWriteError();
+        pending_ += record;
+        ++appended_count_;
+    }
+    has_records_.notify_one();
+}
+
+void MutationLog::Flush() {
+    std::unique_lock lock(mutex_);
+    CheckWriteError();
+    const uint64_t target = appended_count_;
+    if (synced_count_ >= target) {
+        return;
+    }
+    sync_requested_count_ = std::max(sync_requested_count_, target);
+    has_records_.notify_one();
+    progress_.wait(lock, [this, target] {
+        return synced_count_ >= target || !write_error_.empty();
+    });
+    CheckWriteError();
+}
+
+void MutationLog::Truncate() {
+    std::unique_lock lock(mutex_);
+    progress_.wait(lock, [this] {
+        return (pending_.empty() && !is_writing_) || !write_error_.empty();
+    });
+    CheckWriteError();
+    // The background thread is idle while the mutex is held and nothing is pending
+    if (ftruncate(fd_, HEADER_SIZE) != 0 || fdatasync(fd_) != 0) {
+        throw std::runtime_error("Cannot truncate mutation log "s + path_);
+    }
+    written_count_ = synced_count_ = appended_count_;
+}
+
+uint64_t MutationLog::Replay(const std::string& path, const std::function<void(const Record&)>& apply) {
+    std::error_code error;
+    const auto file_size = std::filesystem::file_size(path, error);
+    if (error || file_size < HEADER_SIZE) {
+        return 0;
+    }
+    const MappedFile file(path);
+    uint32_t version = 0;
+    std::memcpy(&version, file.data() + sizeof(LOG_MAGIC), sizeof(version));
+    if (std::memcmp(file.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || version != LOG_VERSION) {
+        throw std::runtime_error("File is not a mutation log "s + path);
+    }
+
+    Record record;
+    size_t position = HEADER_SIZE;
+    while (file.size() - position >= RECORD_HEADER_SIZE) {
+        uint32_t body_size = 0;
+        uint32_t crc = 0;
+        std::memcpy(&body_size, file.data() + position, sizeof(body_size));
+        std::memcpy(&crc, file.data() + position + sizeof(body_size), sizeof(crc));
+        const char* body = file.data() + position + RECORD_HEADER_SIZE;
+        if (body_size > file.size() - position - RECORD_HEADER_SIZE || Crc32(body, body_size) != crc
+            || !DecodeRecord(body, body_size, record)) {
+            break;
+        }
+        apply(record);
+        position += RECORD_HEADER_SIZE + body_size;
+    }
+    return position;
+}
+
+void MutationLog::WriteLoop() {
+    using Clock = std::chrono::steady_clock;
+    auto last_sync = Clock::now();
+    std::string batch;
+    std::unique_lock lock(mutex_);
+    while (true) {
+        const auto has_work = [this] {
+            return stop_ || !pending_.empty() || sync_requested_count_ > synced_count_;
+        };
+        if (options_.sync_policy == LogSyncPolicy::INTERVAL && written_count_ > synced_count_) {
+            has_records_.wait_until(lock, last_sync + options_.sync_interval, has_work);
+        } else {
+            has_records_.wait(lock, has_work);
+        }
+        if (stop_ && pending_.empty() && synced_count_ == written_count_) {
+            return;
+        }
+
+        // Everything appended since the previous write goes in one batch
+        batch.swap(pending_);
+        const uint64_t batch_end = appended_count_;
+        const bool must_sync = stop_ || sync_requested_count_ > synced_count_;
+        is_writing_ = true;
+        lock.unlock();
+
+        std::string error;
+        if (!batch.empty() && !WriteAll(fd_, batch)) {
+            error = "Cannot write mutation log "s + path_;
+        }
+        batch.clear();
+        const auto now = Clock::now();
+        const bool sync = error.empty() && (must_sync || options_.sync_policy == LogSyncPolicy::EVERY_BATCH
+            || (options_.sync_policy == LogSyncPolicy::INTERVAL && now - last_sync >= options_.sync_interval));
+        if (sync) {
+            if (fdatasync(fd_) == 0) {
+                last_sync = now;
+            } else {
+                error = "Cannot sync mutation log "s + path_;
+            }
+        }
+
+        lock.lock();
+        is_writing_ = false;
+        if (error.empty()) {
+            written_count_ = batch_end;
+            if (sync) {
+                synced_count_ = batch_end;
+            }
+        } else {
+            write_error_ = error;
+        }
+        progress_.notify_all();
+        if (!write_error_.empty()) {
+            return;
+        }
+    }
+}
+
+void MutationLog::CheckWriteError() const {
+    if (!write_error_.empty()) {
+        throw std::runtime_error(write_error_);
+    }
+}
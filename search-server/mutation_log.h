@@ -0,0 +1,109 @@
+// Обьявление журнала изменений поисковой системы (write-ahead log)
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+
+// Когда записи журнала сбрасываются на диск
+enum class LogSyncPolicy {
+    // Фоновый поток сбрасывает каждую записанную группу изменений. Добавление записи не ждет диска,
+    // поэтому после возврата из него изменение еще может потеряться при сбое; сохранность
+    // гарантирует только Flush
+    EVERY_BATCH,
+    // Не чаще одного раза за sync_interval, при сбое теряется не больше интервала изменений
+    INTERVAL,
+    // Только по явному вызову, сброс на диск остается операционной системе
+    NEVER,
+};
+
+// Параметры журнала изменений
+struct MutationLogOptions {
+    LogSyncPolicy sync_policy = LogSyncPolicy::EVERY_BATCH;
+    std::chrono::milliseconds sync_interval{ 100 };
+};
+
+// Append-only log of document additions and removals.
+//
+// Every record carries the sequence number of the mutation and a CRC-32 of
+// its contents. Appending only encodes the record into a memory buffer; a
+// background thread writes whatever accumulated since its previous write
+// with a single system call (group commit) and syncs it according to the
+// policy, so neither writers nor queries wait for the disk.
+//
+// Replay stops at the first incomplete or corrupted record: that is the tail
+// a crash could have left, and it is cut off when the log is reopened.
+class MutationLog {
+public:
+    enum class RecordType : uint8_t {
+        ADD_DOCUMENT = 1,
+        REMOVE_DOCUMENT = 2,
+    };
+
+    struct Record {
+        uint64_t sequence;
+        RecordType type;
+        int document_id;
+        // The rest is set for ADD_DOCUMENT only, text points into the replayed file
+        DocumentStatus status;
+        std::vector<int> ratings;
+        std::string_view text;
+    };
+
+    // Opens the log for appending, cutting it to valid_size bytes returned by Replay
+    MutationLog(const std::string& path, uint64_t valid_size, const MutationLogOptions& options);
+    // Writes and syncs the remaining records
+    ~MutationLog();
+
+    MutationLog(const MutationLog&) = delete;
+    MutationLog& operator=(const MutationLog&) = delete;
+
+    // Records are only encoded here, the background thread writes them. Once an
+    // earlier write failed, runtime_error is thrown and nothing is appended
+    void AppendAddDocument(uint64_t sequence, int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    void AppendRemoveDocument(uint64_t sequence, int document_id);
+
+    // Waits until every appended record is written and synced
+    void Flush();
+
+    // Drops every record, called once they are all covered by a snapshot
+    void Truncate();
+
+    // Calls apply for the valid records in order and returns the size of the valid part of the log
+    static uint64_t Replay(const std::string& path, const std::function<void(const Record&)>& apply);
+
+private:
+    void Append(std::string_view record);
+    void WriteLoop();
+    // Throws if the background thread failed to write, must be called under mutex_
+    void CheckWriteError() const;
+
+    const std::string path_;
+    const MutationLogOptions options_;
+    int fd_ = -1;
+
+    std::mutex mutex_;
+    std::condition_variable has_records_;
+    std::condition_variable progress_;
+    // Encoded records not yet taken by the background thread
+    std::string pending_;
+    // Counts of records appended, written to the file and synced
+    uint64_t appended_count_ = 0;
+    uint64_t written_count_ = 0;
+    uint64_t synced_count_ = 0;
+    // Flush asks to sync at least this many records
+    uint64_t sync_requested_count_ = 0;
+    bool is_writing_ = false;
+    bool stop_ = false;
+    std::string write_error_;
+
+    std::thread writer_;
+};
@@ -0,0 +1,242 @@
+// Обьявление массива, который хранит данные сам или ссылается на отображенный в память снимок
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Array of trivially copyable values that either owns them or borrows them
+// from a memory-mapped snapshot. Reads go straight to the borrowed memory;
+// the first mutation copies it, so a loaded index is copied only where changed.
+// The owner of the mapping must outlive every buffer borrowing from it.
+//
+// Copies share the owned storage as well. Every copy sees only its own size
+// of it, so one of them may keep appending into the spare capacity in place;
+// the storage tracks which one, and any other copy that appends or any copy
+// that modifies shared values works on its own copy of the values.
+template <typename T>
+class PodBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "PodBuffer holds only trivially copyable values");
+
+public:
+    PodBuffer() = default;
+    PodBuffer(const PodBuffer&) = default;
+    PodBuffer& operator=(const PodBuffer&) = default;
+
+    PodBuffer(PodBuffer&& other) noexcept
+        : storage_(std::move(other.storage_))
+        , data_(std::exchange(other.data_, nullptr))
+        , size_(std::exchange(other.size_, 0)) {
+    }
+
+    PodBuffer& operator=(PodBuffer&& other) noexcept {
+        storage_ = std::move(other.storage_);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        return *this;
+    }
+
+    static PodBuffer Borrow(const T* data, size_t size) {
+        PodBuffer buffer;
+        if (size > 0) {
+            buffer.data_ = data;
+            buffer.size_ = size;
+        }
+        return buffer;
+    }
+
+    bool IsBorrowed() const {
+        return data_ != nullptr && !storage_;
+    }
+
+    const T* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    const T& back() const {
+        return data_[size_ - 1];
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    // Copies borrowed or shared values before returning them for modification
+    T* MutableData() {
+        if (storage_ && storage_.use_count() == 1) {
+            // Other owners are gone, their reads happened before they released the storage
+            std::atomic_thread_fence(std::memory_order_acquire);
+            storage_->used.store(size_, std::memory_order_relaxed);
+        } else if (size_ > 0) {
+            Reallocate(size_);
+        }
+        return storage_ ? storage_->values.get() : nullptr;
+    }
+
+    void push_back(const T& value) {
+        *AppendSlots(1) = value;
+    }
+
+    // New values are not initialized
+    void resize(size_t size) {
+        if (size > size_) {
+            AppendSlots(size - size_);
+        } else {
+            if (storage_ && storage_.use_count() == 1) {
+                storage_->used.store(size, std::memory_order_relaxed);
+            }
+            size_ = size;
+        }
+    }
+
+    void reserve(size_t capacity) {
+        if (capacity > Capacity()) {
+            Reallocate(capacity);
+        }
+    }
+
+    void shrink_to_fit() {
+        if (size_ == 0) {
+            storage_.reset();
+            data_ = nullptr;
+        } else if (storage_ && storage_->capacity > size_) {
+            Reallocate(size_);
+        }
+    }
+
+    // Bytes of memory taken, mapped ones included
+    size_t MemoryUsage() const {
+        return (storage_ ? storage_->capacity : size_) * sizeof(T);
+    }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 4;
+
+    struct Storage {
+        explicit Storage(size_t capacity)
+            : values(new T[capacity])
+            , capacity(capacity) {
+        }
+
+        std::unique_ptr<T[]> values;
+        const size_t capacity;
+        // Values written by any copy, the copy whose size equals it may append in place
+        std::atomic<size_t> used = 0;
+    };
+
+    size_t Capacity() const {
+        return storage_ ? storage_->capacity : 0;
+    }
+
+    // Returns count values at the end of the array, reserved for this copy only
+    T* AppendSlots(size_t count) {
+        if (storage_ && storage_->capacity - size_ >= count) {
+            size_t expected = size_;
+            if (storage_->used.compare_exchange_strong(expected, size_ + count, std::memory_order_relaxed)) {
+                T* slots = storage_->values.get() + size_;
+                size_ += count;
+                return slots;
+            }
+        }
+        Reallocate(std::max({ size_ + count, size_ * 2, MIN_CAPACITY }));
+        storage_->used.store(size_ + count, std::memory_order_relaxed);
+        T* slots = storage_->values.get() + size_;
+        size_ += count;
+        return slots;
+    }
+
+    void Reallocate(size_t capacity) {
+        auto storage = std::make_shared<Storage>(std::max(capacity, size_));
+        if (size_ > 0) {
+            std::memcpy(storage->values.get(), data_, size_ * sizeof(T));
+        }
+        storage->used.store(size_, std::memory_order_relaxed);
+        storage_ = std::move(storage);
+        data_ = storage_->values.get();
+    }
+
+    std::shared_ptr<Storage> storage_;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Array of trivially copyable values split into pages of PAGE_SIZE values,
+// each page a PodBuffer. Copies share the pages, and changing a value copies
+// only its page if it is shared or borrowed, so a copy costs one pointer per
+// page and a change costs one page. Meant for per-term values that every
+// change of the index updates for a few terms.
+template <typename T>
+class PagedBuffer {
+public:
+    static constexpr size_t PAGE_SIZE = 256;
+
+    // Pages borrow the values, see PodBuffer::Borrow
+    static PagedBuffer Borrow(const T* data, size_t size) {
+        PagedBuffer buffer;
+        for (size_t begin = 0; begin < size; begin += PAGE_SIZE) {
+            buffer.pages_.push_back(PodBuffer<T>::Borrow(data + begin, std::min(PAGE_SIZE, size - begin)));
+        }
+        buffer.size_ = size;
+        return buffer;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    const T& operator[](size_t index) const {
+        return pages_[index / PAGE_SIZE][index % PAGE_SIZE];
+    }
+
+    // Copies the page of the value before returning it for modification
+    T& Mutable(size_t index) {
+        return pages_[index / PAGE_SIZE].MutableData()[index % PAGE_SIZE];
+    }
+
+    // Appends copies of the value up to the size
+    void Grow(size_t size, const T& value) {
+        while (size_ < size) {
+            if (size_ % PAGE_SIZE == 0) {
+                pages_.emplace_back().reserve(PAGE_SIZE);
+            }
+            pages_.back().push_back(value);
+            ++size_;
+        }
+    }
+
+    const std::vector<PodBuffer<T>>& GetPages() const {
+        return pages_;
+    }
+
+    size_t MemoryUsage() const {
+        size_t bytes = pages_.capacity() * sizeof(PodBuffer<T>);
+        for (const PodBuffer<T>& page : pages_) {
+            bytes += page.MemoryUsage();
+        }
+        return bytes;
+    }
+
+private:
+    std::vector<PodBuffer<T>> pages_;
+    size_t size_ = 0;
+};
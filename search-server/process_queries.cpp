@@ -4,31 +4,137 @@
 #include <algorithm>
 #include <numeric>
 #include <utility>
+#include <future>
+#include <thread>
 
 #include "document.h"
 #include "process_queries.h"
 #include "search_server.h"
 
+namespace {
+// Queries of a batch share lookups and scans of their words, batches run in parallel
+constexpr size_t QUERY_BATCH_SIZE = 64;
+}
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries)
 {
     std::vector<std::vector<Document>> result(queries.size());
 
-    std::transform(std::execution::par, queries.begin(), queries.end(), result.begin(),
-    [&search_server](const auto& query){
-        return search_server.FindTopDocuments(query);
+    const size_t batch_count = (queries.size() + QUERY_BATCH_SIZE - 1) / QUERY_BATCH_SIZE;
+    search_server.GetQueryExecutor()->ParallelFor(batch_count,
+    [&search_server, &queries, &result](size_t batch){
+        const size_t begin = batch * QUERY_BATCH_SIZE;
+        const size_t end = std::min(queries.size(), begin + QUERY_BATCH_SIZE);
+        auto batch_result = search_server.FindTopDocumentsBatch({ queries.begin() + begin, queries.begin() + end });
+        std::move(batch_result.begin(), batch_result.end(), result.begin() + begin);
     });
     return result;    
 }
 
-std::vector<Document> ProcessQueriesJoined(
+JoinedQueryResults::JoinedQueryResults(const SearchServer& search_server, std::vector<std::string> queries,
+    size_t max_batches_in_flight)
+    : search_server_(&search_server)
+    , queries_(std::make_shared<const std::vector<std::string>>(std::move(queries)))
+{
+    for (size_t i = 0; i < std::max<size_t>(max_batches_in_flight, 1); ++i) {
+        Launch();
+    }
+}
+
+JoinedQueryResults::JoinedQueryResults(JoinedQueryResults&& other) noexcept
+    : search_server_(other.search_server_)
+    , queries_(std::move(other.queries_))
+    , next_query_(std::exchange(other.next_query_, 0))
+    , in_flight_(std::exchange(other.in_flight_, {}))
+    , batch_(std::exchange(other.batch_, {}))
+    , query_index_(std::exchange(other.query_index_, 0))
+    , document_index_(std::exchange(other.document_index_, 0))
+{
+}
+
+JoinedQueryResults& JoinedQueryResults::operator=(JoinedQueryResults&& other) noexcept {
+    if (this != &other) {
+        Cancel();
+        search_server_ = other.search_server_;
+        queries_ = std::move(other.queries_);
+        next_query_ = std::exchange(other.next_query_, 0);
+        in_flight_ = std::exchange(other.in_flight_, {});
+        batch_ = std::exchange(other.batch_, {});
+        query_index_ = std::exchange(other.query_index_, 0);
+        document_index_ = std::exchange(other.document_index_, 0);
+    }
+    return *this;
+}
+
+JoinedQueryResults::~JoinedQueryResults() {
+    Cancel();
+}
+
+void JoinedQueryResults::RunBatch(const SearchServer& search_server, const std::vector<std::string>& queries,
+    Batch& batch) {
+    if (batch.is_taken.exchange(true)) {
+        return;
+    }
+    try {
+        batch.promise.set_value(search_server.FindTopDocumentsBatch(
+            { queries.begin() + batch.begin, queries.begin() + batch.end }));
+    } catch (...) {
+        batch.promise.set_exception(std::current_exception());
+    }
+}
+
+void JoinedQueryResults::Launch() {
+    if (!queries_ || next_query_ == queries_->size()) {
+        return;
+    }
+    auto batch = std::make_shared<Batch>();
+    batch->begin = next_query_;
+    batch->end = std::min(queries_->size(), batch->begin + QUERY_BATCH_SIZE);
+    batch->result = batch->promise.get_future();
+    next_query_ = batch->end;
+    in_flight_.push_back(batch);
+    search_server_->GetQueryExecutor()->Submit([&search_server = *search_server_, queries = queries_, batch] {
+        RunBatch(search_server, *queries, *batch);
+    });
+}
+
+void JoinedQueryResults::Cancel() {
+    for (const auto& batch : in_flight_) {
+        // A task finding its batch taken returns without touching the search server
+        if (batch->is_taken.exchange(true)) {
+            batch->result.wait();
+        }
+    }
+    in_flight_.clear();
+}
+
+void JoinedQueryResults::SkipFinished() {
+    while (true) {
+        while (query_index_ < batch_.size() && document_index_ == batch_[query_index_].size()) {
+            ++query_index_;
+            document_index_ = 0;
+        }
+        if (query_index_ < batch_.size() || in_flight_.empty()) {
+            return;
+        }
+        // The batch is released before the next one is taken, so memory stays bounded
+        batch_.clear();
+        query_index_ = 0;
+        const auto next_batch = std::move(in_flight_.front());
+        in_flight_.pop_front();
+        Launch();
+        // Waiting for a task still queued could block a pool worker on work queued behind it
+        RunBatch(*search_server_, *queries_, *next_batch);
+        batch_ = next_batch->result.get();
+    }
+}
+
+JoinedQueryResults ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries)
+    std::vector<std::string> queries)
 {   
-    std::vector<Document> result_queries;
-    for(const auto& documents : ProcessQueries(search_server, queries)) {
-        result_queries.insert(result_queries.end(), documents.begin(), documents.end());
-    }
-    return result_queries;
-}
\ No newline at end of file
+    const size_t max_batches_in_flight = search_server.GetQueryExecutor()->GetWorkerCount();
+    return JoinedQueryResults(search_server, std::move(queries), max_batches_in_flight);
+}
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <iterator>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -10,6 +16,130 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::vector<Document> ProcessQueriesJoined(
+// Результаты запросов одной последовательностью документов в порядке запросов.
+// Запросы выполняются пакетами по мере чтения, одновременно не больше max_batches_in_flight пакетов,
+// поэтому первые документы доступны сразу после первого пакета, а память не зависит от числа запросов.
+// Запросы хранятся в результатах, поисковая система должна существовать, пока они не уничтожены.
+// Пакет, который еще не начал выполняться в пуле, выполняется в читающем потоке, а не ожидается.
+// Ошибка в запросе выбрасывается при переходе к результатам его пакета
+class JoinedQueryResults {
+public:
+    // Single-pass iterator, every copy of it reads the same results
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Document;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Document*;
+        using reference = const Document&;
+
+        Iterator() = default;
+
+        reference operator*() const {
+            return results_->Current();
+        }
+
+        pointer operator->() const {
+            return &results_->Current();
+        }
+
+        Iterator& operator++() {
+            results_->Next();
+            if (results_->AtEnd()) {
+                results_ = nullptr;
+            }
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return results_ == other.results_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return results_ != other.results_;
+        }
+
+    private:
+        friend class JoinedQueryResults;
+
+        explicit Iterator(JoinedQueryResults* results)
+            : results_(results->AtEnd() ? nullptr : results) {
+        }
+
+        // nullptr past the last document
+        JoinedQueryResults* results_ = nullptr;
+    };
+
+    JoinedQueryResults(const SearchServer& search_server, std::vector<std::string> queries,
+        size_t max_batches_in_flight);
+    // Итераторы перемещенных результатов становятся недействительными
+    JoinedQueryResults(JoinedQueryResults&& other) noexcept;
+    JoinedQueryResults& operator=(JoinedQueryResults&& other) noexcept;
+
+    // Дожидается выполняющихся пакетов, они ссылаются на поисковую систему
+    ~JoinedQueryResults();
+
+    // Ждет первый пакет с результатами
+    Iterator begin() {
+        SkipFinished();
+        return Iterator(this);
+    }
+
+    Iterator end() {
+        return Iterator();
+    }
+
+private:
+    using BatchResult = std::vector<std::vector<Document>>;
+
+    // Queries [begin, end), run by whoever takes it first: its task in the pool or the reader
+    struct Batch {
+        size_t begin;
+        size_t end;
+        std::atomic<bool> is_taken = false;
+        std::promise<BatchResult> promise;
+        std::future<BatchResult> result;
+    };
+
+    // Runs the batch unless it is already taken
+    static void RunBatch(const SearchServer& search_server, const std::vector<std::string>& queries, Batch& batch);
+
+    // Starts the next batch of queries if any is left
+    void Launch();
+    // Waits for the batches being run, the ones not taken yet are dropped
+    void Cancel();
+    // Moves past the queries whose documents are all read, waiting for the next batch when needed
+    void SkipFinished();
+
+    bool AtEnd() const {
+        return query_index_ == batch_.size() && in_flight_.empty();
+    }
+
+    const Document& Current() const {
+        return batch_[query_index_][document_index_];
+    }
+
+    void Next() {
+        ++document_index_;
+        SkipFinished();
+    }
+
+    const SearchServer* search_server_;
+    // Shared with the tasks, which may start after the results are gone
+    std::shared_ptr<const std::vector<std::string>> queries_;
+    size_t next_query_ = 0;
+    // Batches in query order, at most max_batches_in_flight of them
+    std::deque<std::shared_ptr<Batch>> in_flight_;
+    // Batch being read and the position in it
+    BatchResult batch_;
+    size_t query_index_ = 0;
+    size_t document_index_ = 0;
+};
+
+JoinedQueryResults ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    std::vector<std::string> queries);
@@ -0,0 +1,25 @@
+// Обьявление отмены поисковых запросов
+#pragma once
+#include <atomic>
+#include <stdexcept>
+
+// Отмена запросов: передается в SearchOptions, вызывающий может отменить запрос в любой момент
+class QueryCancellation {
+public:
+    void Cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> cancelled_ = false;
+};
+
+// Исключение запроса, который отменен или не уложился в срок
+class QueryCancelled : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
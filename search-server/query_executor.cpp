@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "query_executor.h"
+
+namespace {
+// Pool and worker index of the calling thread, set for workers only
+thread_local const QueryExecutor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+}
+
+QueryExecutor::QueryExecutor(const QueryExecutorOptions& options)
+    : max_queued_tasks_(std::max<size_t>(options.max_queued_tasks, 1)) {
+    const size_t worker_count = options.worker_count > 0
+        ? options.worker_count
+        : std::max(1u, std::thread::hardware_concurrency());
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    // Threads start once every deque exists, they steal from all of them
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_[i]->thread = std::thread([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        std::lock_guard guard(sleep_mutex_);
+        stop_ = true;
+    }
+    has_tasks_.notify_all();
+    // A task may drop the last reference to the pool. Its worker cannot join itself,
+    // so it finishes the queue, detaches and leaves its loop without touching the pool
+    const size_t current = GetCurrentWorker();
+    if (current != NO_WORKER) {
+        while (TryRunTask(current)) {
+        }
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        if (i == current) {
+            workers_[i]->thread.detach();
+        } else {
+            workers_[i]->thread.join();
+        }
+    }
+    if (current != NO_WORKER) {
+        current_executor = nullptr;
+    }
+}
+
+const std::shared_ptr<QueryExecutor>& QueryExecutor::GetDefault() {
+    static const std::shared_ptr<QueryExecutor> executor = std::make_shared<QueryExecutor>();
+    return executor;
+}
+
+bool QueryExecutor::TrySubmit(Task task) {
+    if (GetCurrentWorker() == NO_WORKER && queued_count_.load(std::memory_order_relaxed) >= max_queued_tasks_) {
+        return false;
+    }
+    Push(std::move(task));
+    return true;
+}
+
+void QueryExecutor::Submit(Task task) {
+    if (GetCurrentWorker() == NO_WORKER) {
+        std::unique_lock lock(sleep_mutex_);
+        has_space_.wait(lock, [this] {
+            return queued_count_.load(std::memory_order_relaxed) < max_queued_tasks_;
+        });
+    }
+    Push(std::move(task));
+}
+
+void QueryExecutor::ParallelFor(size_t count, const std::function<void(size_t)>& function) {
+    if (count <= 1) {
+        if (count == 1) {
+            function(0);
+        }
+        return;
+    }
+
+    // Parts are claimed by index, so the caller runs whatever the workers have not
+    // taken yet. Helpers may start after the call returns, they only find no part left
+    struct State {
+        const std::function<void(size_t)>* function;
+        size_t count;
+        std::atomic<size_t> next = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+        // Parts finished, changed under mutex so that the caller outlives the last notification
+        size_t finished = 0;
+        std::exception_ptr error;
+
+        // Runs parts until none is left to claim
+        void RunParts() {
+            for (size_t index = next.fetch_add(1); index < count; index = next.fetch_add(1)) {
+                std::exception_ptr part_error;
+                try {
+                    (*function)(index);
+                } catch (...) {
+                    part_error = std::current_exception();
+                }
+                std::lock_guard guard(mutex);
+                if (part_error && !error) {
+                    error = part_error;
+                }
+                if (++finished == count) {
+                    done.notify_all();
+                }
+            }
+        }
+    };
+    const auto state = std::make_shared<State>();
+    state->function = &function;
+    state->count = count;
+    const size_t helper_count = std::min(count - 1, workers_.size());
+    for (size_t i = 0; i < helper_count; ++i) {
+        Push([state] {
+            state->RunParts();
+        });
+    }
+    state->RunParts();
+
+    // The parts left are running. A worker helps with queued tasks meanwhile; any other
+    // thread only waits, it must not delay its own call with unrelated tasks
+    const size_t worker = GetCurrentWorker();
+    while (true) {
+        {
+            std::lock_guard guard(state->mutex);
+            if (state->finished == count) {
+                break;
+            }
+        }
+        if (worker == NO_WORKER || !TryRunTask(worker)) {
+            std::unique_lock lock(state->mutex);
+            state->done.wait(lock, [&state, count] {
+                return state->finished == count;
+            });
+            break;
+        }
+    }
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+size_t QueryExecutor::GetCurrentWorker() const {
+    return current_executor == this ? current_worker : NO_WORKER;
+}
+
+void QueryExecutor::Push(Task task) {
+    size_t worker = GetCurrentWorker();
+    if (worker == NO_WORKER) {
+        worker = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    }
+    // Counted before it can be taken, so the count never goes below zero
+    queued_count_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard guard(workers_[worker]->mutex);
+        workers_[worker]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taken so that a worker checking the count cannot miss the notification
+        std::lock_guard guard(sleep_mutex_);
+    }
+    has_tasks_.notify_one();
+}
+
+bool QueryExecutor::TryRunTask(size_t worker) {
+    Task task;
+    {
+        Worker& own = *workers_[worker];
+        std::lock_guard guard(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    if (!task) {
+        for (size_t i = 1; i <= workers_.size() && !task; ++i) {
+            Worker& victim = *workers_[(worker + i) % workers_.size()];
+            std::lock_guard guard(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    queued_count_.fetch_sub(1, std::memory_order_relaxed);
+    {
+        std::lock_guard guard(sleep_mutex_);
+    }
+    has_space_.notify_one();
+    task();
+    // Captures are released here, this may destroy the pool
+    task = nullptr;
+    return true;
+}
+
+void QueryExecutor::WorkerLoop(size_t worker) {
+    current_executor = this;
+    current_worker = worker;
+    while (true) {
+        if (TryRunTask(worker)) {
+            if (current_executor != this) {
+                // The pool was destroyed by the task
+                return;
+            }
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        has_tasks_.wait(lock, [this] {
+            return stop_ || queued_count_.load(std::memory_order_relaxed) > 0;
+        });
+        if (stop_ && queued_count_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+    }
+}
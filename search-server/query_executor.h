@@ -0,0 +1,109 @@
+// Обьявление пула потоков, на котором выполняются поисковые запросы
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Параметры пула потоков для запросов
+struct QueryExecutorOptions {
+    // Число рабочих потоков, 0 - по числу ядер
+    size_t worker_count = 0;
+    // Сколько задач может ждать выполнения, сверх этого новые задачи не принимаются
+    size_t max_queued_tasks = 4096;
+};
+
+// Work-stealing pool running both whole queries and the parts of a single
+// query. Every worker has its own deque: it pushes and pops its tasks at the
+// back and, once it runs out, steals the oldest tasks of the other workers.
+// A query split by ParallelFor from a worker pushes its parts onto the same
+// deques, so nested parallelism never creates threads beyond worker_count.
+// A thread outside the pool runs only the parts of its own ParallelFor.
+//
+// Admission control: TrySubmit rejects a task and Submit blocks while
+// max_queued_tasks tasks wait for a worker. Parts of a running query are
+// queued regardless of the limit, they only ever finish already admitted work.
+class QueryExecutor {
+public:
+    using Task = std::function<void()>;
+
+    explicit QueryExecutor(const QueryExecutorOptions& options = {});
+    // Выполняет поставленные задачи и останавливает потоки
+    ~QueryExecutor();
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    // Пул по умолчанию для всех поисковых систем
+    static const std::shared_ptr<QueryExecutor>& GetDefault();
+
+    size_t GetWorkerCount() const {
+        return workers_.size();
+    }
+
+    // Задачи, которые ждут рабочего потока
+    size_t GetQueuedTaskCount() const {
+        return queued_count_.load(std::memory_order_relaxed);
+    }
+
+    // Ставит задачу в очередь, если в ней есть место. Задача не должна выбрасывать исключений
+    bool TrySubmit(Task task);
+    // Ждет места в очереди. Из рабочих потоков пула задача ставится сразу, иначе пул мог бы ждать сам себя
+    void Submit(Task task);
+
+    // Выполняет function в пуле, результат или исключение передается через future
+    template <typename Function>
+    auto Async(Function function) -> std::future<std::invoke_result_t<Function&>>;
+
+    // Вызывает function(i) для каждого i из [0, count) в рабочих потоках и в вызывающем потоке,
+    // возвращается после завершения всех вызовов. Первое исключение выбрасывается после этого
+    void ParallelFor(size_t count, const std::function<void(size_t)>& function);
+
+private:
+    static constexpr size_t NO_WORKER = static_cast<size_t>(-1);
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    // Index of the calling thread among the workers of this pool or NO_WORKER
+    size_t GetCurrentWorker() const;
+    // Puts the task on the deque of the calling worker or, for other threads, of the next worker in turn
+    void Push(Task task);
+    // Runs a task of the worker's own deque or a stolen one, returns false if every deque is empty.
+    // Only workers run queued tasks, a thread outside the pool never takes them
+    bool TryRunTask(size_t worker);
+    void WorkerLoop(size_t worker);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    const size_t max_queued_tasks_;
+    std::atomic<size_t> queued_count_ = 0;
+    std::atomic<size_t> next_worker_ = 0;
+
+    // Guards sleeping of workers and of blocked submitters
+    std::mutex sleep_mutex_;
+    std::condition_variable has_tasks_;
+    std::condition_variable has_space_;
+    bool stop_ = false;
+};
+
+template <typename Function>
+auto QueryExecutor::Async(Function function) -> std::future<std::invoke_result_t<Function&>> {
+    using Result = std::invoke_result_t<Function&>;
+    // std::function needs a copyable task
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+    auto result = task->get_future();
+    Submit([task] {
+        (*task)();
+    });
+    return result;
+}
@@ -15,7 +15,7 @@
    методом .count()*/
 
    
-   void RemoveDuplicates(SearchServer& search_server)
+   void RemoveDuplicates(SearchServer& search_server, std::ostream& out)
    {
 	   using namespace std;
 
@@ -25,7 +25,7 @@
 	   for (const int & id : search_server) {	   
 		   const auto & word_to_freq = search_server.GetWordFrequencies(id);
 		   if (words_words_freqs.count(word_to_freq) > 0) {
-			   cout << "Found duplicate document id "s << id << endl;
+			   out << "Found duplicate document id "s << id << endl;
 			   ids_to_delete_.push_back(id);
 			   continue;
 		   }
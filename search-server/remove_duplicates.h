@@ -1,5 +1,7 @@
 #pragma once
 #include "search_server.h"
 
-/* Поиск и удаление дубликатов документов */
-void RemoveDuplicates(SearchServer& search_server);
+#include <iostream>
+
+/* Поиск и удаление дубликатов документов, о каждом найденном сообщается в out */
+void RemoveDuplicates(SearchServer& search_server, std::ostream& out = std::cout);
@@ -8,7 +8,7 @@
 #include "document.h"
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+    return AddFindRequest(raw_query, [status](int, DocumentStatus document_status, int) {
         return document_status == status;
     });
 }
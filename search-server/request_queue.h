@@ -36,7 +36,7 @@ std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query,
     if (requests_.size() >= 1440) {
         requests_.pop_front();
     }
-    const auto result = search_server_request.FindTopDocuments(raw_query);
+    const auto result = search_server_request.FindTopDocuments(raw_query, document_predicate);
     requests_.push_back({ result.size(), result.empty()});
     return result;
 }
\ No newline at end of file
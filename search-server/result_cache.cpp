@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "result_cache.h"
+
+QueryResultCache::QueryResultCache(const QueryResultCacheOptions& options) {
+    const size_t shard_count = std::max<size_t>(options.shard_count, 1);
+    shard_capacity_ = std::max<size_t>((options.capacity + shard_count - 1) / shard_count, 1);
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::optional<std::vector<Document>> QueryResultCache::Find(const std::string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++shard.misses;
+        return std::nullopt;
+    }
+    if (it->second->generation != generation) {
+        ++shard.invalidations;
+        ++shard.misses;
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+        return std::nullopt;
+    }
+    ++shard.hits;
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    return it->second->documents;
+}
+
+void QueryResultCache::Insert(const std::string& key, uint64_t generation, const std::vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    if (const auto it = shard.index.find(key); it != shard.index.end()) {
+        // A query computed on an older server must not replace a newer result
+        if (it->second->generation > generation) {
+            return;
+        }
+        it->second->generation = generation;
+        it->second->documents = documents;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    shard.entries.push_front({ key, generation, documents });
+    shard.index.emplace(key, shard.entries.begin());
+    if (shard.entries.size() > shard_capacity_) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        ++shard.evictions;
+    }
+}
+
+QueryResultCacheStats QueryResultCache::GetStats() const {
+    QueryResultCacheStats stats;
+    for (const auto& shard : shards_) {
+        std::lock_guard guard(shard->mutex);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.evictions += shard->evictions;
+        stats.invalidations += shard->invalidations;
+        stats.size += shard->entries.size();
+    }
+    return stats;
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const std::string& key) {
+    return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
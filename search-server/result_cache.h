@@ -0,0 +1,74 @@
+// Обьявление кэша результатов поисковых запросов
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+// Параметры кэша результатов
+struct QueryResultCacheOptions {
+    // Сколько результатов запросов хранится всего
+    size_t capacity = 10'000;
+    // На сколько независимых частей с отдельными блокировками делится кэш
+    size_t shard_count = 16;
+};
+
+// Счетчики кэша результатов
+struct QueryResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Результаты, вытесненные давно не запрошенными
+    uint64_t evictions = 0;
+    // Результаты, устаревшие после изменения поисковой системы
+    uint64_t invalidations = 0;
+    size_t size = 0;
+};
+
+// Concurrent LRU cache of top documents. Keys are hashed to shards, each
+// shard has its own lock, list in order of use and capacity/shard_count
+// entries. Every entry carries the generation of the search server it was
+// computed on; a lookup with another generation drops it, so a mutation of
+// the server invalidates all its results at once without touching the cache.
+class QueryResultCache {
+public:
+    explicit QueryResultCache(const QueryResultCacheOptions& options = {});
+
+    QueryResultCache(const QueryResultCache&) = delete;
+    QueryResultCache& operator=(const QueryResultCache&) = delete;
+
+    // Результат, вычисленный для того же поколения поисковой системы
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+    void Insert(const std::string& key, uint64_t generation, const std::vector<Document>& documents);
+
+    QueryResultCacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+    };
+
+    Shard& GetShard(const std::string& key);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_capacity_;
+};
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "score_accumulator.h"
+
+void ScoreAccumulator::Reset(DocOrdinal begin, DocOrdinal end, size_t posting_volume) {
+    touched_.clear();
+    const size_t ordinal_count = end - begin;
+    if (posting_volume * DENSE_RATIO >= ordinal_count) {
+        mode_ = Mode::DENSE;
+        begin_ = begin;
+        if (scores_.size() < ordinal_count) {
+            scores_.resize(ordinal_count);
+            epochs_.resize(ordinal_count, epoch_);
+        }
+        if (++epoch_ == 0) {
+            // Stamps wrapped around, old ones could be taken for current
+            std::fill(epochs_.begin(), epochs_.end(), 0);
+            epoch_ = 1;
+        }
+    } else {
+        mode_ = Mode::HASH;
+        size_t capacity = 16;
+        while (capacity < posting_volume * 2) {
+            capacity *= 2;
+        }
+        if (keys_.size() < capacity) {
+            keys_.resize(capacity);
+            values_.resize(capacity);
+        }
+        // Keep the table no larger than needed, a sparse table costs a clear and cache misses
+        if (keys_.size() > capacity * 4) {
+            keys_.resize(capacity);
+            values_.resize(capacity);
+            keys_.shrink_to_fit();
+            values_.shrink_to_fit();
+        }
+        std::fill(keys_.begin(), keys_.end(), EMPTY_KEY);
+        hash_mask_ = keys_.size() - 1;
+    }
+}
+
+void ScoreAccumulator::Rehash(size_t capacity) {
+    std::vector<double> values(capacity);
+    std::vector<DocOrdinal> keys(capacity, EMPTY_KEY);
+    keys_.swap(keys);
+    values_.swap(values);
+    hash_mask_ = capacity - 1;
+    for (const DocOrdinal document : touched_) {
+        size_t old_slot = Hash(document) & (keys.size() - 1);
+        while (keys[old_slot] != document) {
+            old_slot = (old_slot + 1) & (keys.size() - 1);
+        }
+        const size_t slot = FindSlot(document);
+        keys_[slot] = document;
+        values_[slot] = values[old_slot];
+    }
+}
+
+namespace {
+
+struct AccumulatorSlot {
+    ScoreAccumulator accumulator;
+    bool in_use = false;
+};
+
+thread_local AccumulatorSlot thread_accumulator;
+
+} // namespace
+
+PooledScoreAccumulator::PooledScoreAccumulator() {
+    if (thread_accumulator.in_use) {
+        temporary_ = std::make_unique<ScoreAccumulator>();
+        accumulator_ = temporary_.get();
+    } else {
+        thread_accumulator.in_use = true;
+        accumulator_ = &thread_accumulator.accumulator;
+    }
+}
+
+PooledScoreAccumulator::~PooledScoreAccumulator() {
+    if (!temporary_) {
+        thread_accumulator.in_use = false;
+    }
+}
@@ -0,0 +1,127 @@
+// Обьявление накопителя релевантности документов во время выполнения запроса
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "inverted_index.h"
+
+// Relevance per document ordinal for one query or for a range of ordinals of it.
+// Either a dense array over the range with epoch stamps (no clearing between
+// queries) or, for queries touching few documents, an open-addressing hash table.
+class ScoreAccumulator {
+public:
+    enum class Mode {
+        DENSE,
+        HASH,
+    };
+
+    // Dense mode is chosen when postings cover at least 1/DENSE_RATIO of the range
+    static constexpr size_t DENSE_RATIO = 16;
+
+    // Prepares the accumulator for documents with ordinals in [begin, end)
+    void Reset(DocOrdinal begin, DocOrdinal end, size_t posting_volume);
+
+    void Add(DocOrdinal document, double relevance) {
+        if (mode_ == Mode::DENSE) {
+            const size_t index = document - begin_;
+            if (epochs_[index] != epoch_) {
+                epochs_[index] = epoch_;
+                scores_[index] = relevance;
+                touched_.push_back(document);
+            } else {
+                scores_[index] += relevance;
+            }
+        } else {
+            values_[HashSlot(document)] += relevance;
+        }
+    }
+
+    Mode GetMode() const {
+        return mode_;
+    }
+
+    // Calls action(ordinal, relevance) for every accumulated document
+    template <typename Action>
+    void ForEach(Action action) const {
+        if (mode_ == Mode::DENSE) {
+            for (const DocOrdinal document : touched_) {
+                action(document, scores_[document - begin_]);
+            }
+        } else {
+            for (const DocOrdinal document : touched_) {
+                action(document, values_[FindSlot(document)]);
+            }
+        }
+    }
+
+private:
+    static constexpr DocOrdinal EMPTY_KEY = std::numeric_limits<DocOrdinal>::max();
+
+    size_t FindSlot(DocOrdinal document) const {
+        size_t slot = Hash(document) & hash_mask_;
+        while (keys_[slot] != document && keys_[slot] != EMPTY_KEY) {
+            slot = (slot + 1) & hash_mask_;
+        }
+        return slot;
+    }
+
+    // Slot of the document, inserted with zero relevance if it is new
+    size_t HashSlot(DocOrdinal document) {
+        size_t slot = FindSlot(document);
+        if (keys_[slot] == EMPTY_KEY) {
+            if ((touched_.size() + 1) * 2 > keys_.size()) {
+                Rehash(keys_.size() * 2);
+                slot = FindSlot(document);
+            }
+            keys_[slot] = document;
+            values_[slot] = 0;
+            touched_.push_back(document);
+        }
+        return slot;
+    }
+
+    static size_t Hash(DocOrdinal document) {
+        return static_cast<size_t>(document) * 0x9E3779B97F4A7C15ull >> 16;
+    }
+
+    void Rehash(size_t capacity);
+
+    Mode mode_ = Mode::DENSE;
+    // Documents with a score in the current query, in the order they were met
+    std::vector<DocOrdinal> touched_;
+
+    DocOrdinal begin_ = 0;
+    std::vector<double> scores_;
+    std::vector<uint32_t> epochs_;
+    uint32_t epoch_ = 0;
+
+    std::vector<DocOrdinal> keys_;
+    std::vector<double> values_;
+    size_t hash_mask_ = 0;
+};
+
+// Accumulator reused by all queries running on the current thread, so
+// steady-state queries do not allocate. If the thread's accumulator is
+// already taken (nested query), a temporary one is used instead.
+class PooledScoreAccumulator {
+public:
+    PooledScoreAccumulator();
+    ~PooledScoreAccumulator();
+
+    PooledScoreAccumulator(const PooledScoreAccumulator&) = delete;
+    PooledScoreAccumulator& operator=(const PooledScoreAccumulator&) = delete;
+
+    ScoreAccumulator& operator*() const {
+        return *accumulator_;
+    }
+
+    ScoreAccumulator* operator->() const {
+        return accumulator_;
+    }
+
+private:
+    std::unique_ptr<ScoreAccumulator> temporary_;
+    ScoreAccumulator* accumulator_;
+};
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <map>
@@ -15,13 +17,17 @@
 #include <mutex>
 #include <future>
 #include <iterator>
+#include <filesystem>
+#include <fstream>
+#include <exception>
+#include <memory>
+#include <thread>
 
 #include "document.h"
 #include "read_input_functions.h"
 #include "string_processing.h"
 #include "search_server.h"
 #include "process_queries.h"
-#include "concurrent_map.h"
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
@@ -31,144 +37,844 @@ void AddDocument(SearchServer& search_server, int document_id, std::string_view
     search_server.AddDocument(document_id, document, status, ratings);
 }
 
+SearchServer::SearchServer(const SearchServer& other)
+    : snapshot_(other.snapshot_)
+    , terms_(other.terms_)
+    , stop_words_(other.stop_words_)
+    , index_(other.index_)
+    , idf_(other.GetRefreshedInverseDocumentFreqs())
+    , executor_(other.executor_)
+    , result_cache_(other.result_cache_)
+    , generation_(other.generation_)
+    , documents_(other.documents_)
+    , document_ordinals_(other.document_ordinals_)
+    , document_terms_(other.document_terms_)
+    , document_term_ends_(other.document_term_ends_)
+    , mutation_sequence_(other.mutation_sequence_) {
+}
+
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
     const std::vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    METRIC_STAGE(INGEST_DOCUMENT);
+    if ((document_id < 0) || document_ordinals_.Contains(document_id)) {
         throw std::invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
-
-    const double inv_word_count = 1.0 / words.size();
+    // Reused by every document the thread adds
+    thread_local std::vector<std::string_view> words;
+    SplitIntoWordsNoStop(document, words);
+    // Logged before it is applied, a failed append leaves the server unchanged
+    LogAddDocument(document_id, document, status, ratings);
+    generation_ = NextGeneration();
+    METRIC_STAGE(INGEST_INDEX);
+
+    std::map<TermId, uint32_t> term_counts;
     for (const auto& word : words) {
-        const auto view_word = ValidateView(word);
-        word_to_document_freqs_[view_word][document_id] += inv_word_count;
-        id_to_words_freqs_[document_id][view_word] = 0;
+        ++term_counts[terms_.Intern(word)];
+    }
+
+    const DocOrdinal ordinal = static_cast<DocOrdinal>(documents_.size());
+    for (const auto& [term, count] : term_counts) {
+        index_.Add(term, ordinal, count, static_cast<uint32_t>(words.size()));
+        idf_.MarkTermChanged(term);
+        document_terms_.push_back(term);
+    }
+    document_term_ends_.push_back(document_terms_.size());
+    documents_.push_back({ document_id, ComputeAverageRating(ratings), status });
+    index_.FinishDocuments(ordinal + 1);
+    document_ordinals_.Insert(document_id, ordinal);
+    idf_.MarkDocumentCountChanged();
+    METRIC_COUNT(ADDED_DOCUMENTS, 1);
+}
+
+void SearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const std::execution::sequenced_policy&, const std::vector<DocumentToAdd>& documents) {
+    AddDocumentsInParts(documents, 1);
+}
+
+void SearchServer::AddDocuments(const std::execution::parallel_policy&, const std::vector<DocumentToAdd>& documents) {
+    AddDocumentsInParts(documents, std::min<size_t>(executor_->GetWorkerCount(),
+        documents.size() / MIN_DOCUMENTS_PER_TASK));
+}
+
+void SearchServer::AddDocumentsInParts(const std::vector<DocumentToAdd>& documents, size_t task_count) {
+    METRIC_STAGE(INGEST_BATCH);
+    generation_ = NextGeneration();
+    // Only the documents before the first one AddDocument would reject are added
+    size_t valid_count = 0;
+    std::set<int> batch_ids;
+    while (valid_count < documents.size()) {
+        const int document_id = documents[valid_count].id;
+        if (document_id < 0 || document_ordinals_.Contains(document_id) || !batch_ids.insert(document_id).second) {
+            break;
+        }
+        ++valid_count;
+    }
+    std::exception_ptr error;
+    if (valid_count < documents.size()) {
+        error = std::make_exception_ptr(std::invalid_argument("Invalid document_id"s));
+    }
+
+    task_count = std::max<size_t>(1, std::min(task_count, valid_count));
+    const auto task_begin = [valid_count, task_count](size_t task) {
+        return valid_count * task / task_count;
+    };
+    std::vector<PartialIndex> parts(task_count);
+    std::vector<std::exception_ptr> task_errors(task_count);
+    // Every task stops at its first document with an invalid word
+    std::vector<size_t> task_ends(task_count);
+    std::vector<uint32_t> document_lengths(valid_count);
+    executor_->ParallelFor(task_count, [&](size_t task) {
+        PartialIndex& part = parts[task];
+        std::vector<uint32_t> counts;
+        std::vector<uint32_t> document_terms;
+        std::vector<std::string_view> words;
+        size_t i = task_begin(task);
+        for (const size_t end = task_begin(task + 1); i < end; ++i) {
+            try {
+                SplitIntoWordsNoStop(documents[i].text, words);
+            } catch (...) {
+                task_errors[task] = std::current_exception();
+                break;
+            }
+            for (const std::string_view word : words) {
+                const auto [it, inserted] = part.term_ids.emplace(word, static_cast<uint32_t>(part.terms.size()));
+                if (inserted) {
+                    part.terms.push_back(word);
+                    part.postings.emplace_back();
+                    counts.push_back(0);
+                }
+                if (counts[it->second]++ == 0) {
+                    document_terms.push_back(it->second);
+                }
+            }
+            for (const uint32_t term : document_terms) {
+                part.postings[term].push_back({ static_cast<uint32_t>(i), counts[term] });
+                part.document_terms.push_back(term);
+                counts[term] = 0;
+            }
+            document_terms.clear();
+            part.document_term_ends.push_back(part.document_terms.size());
+            document_lengths[i] = static_cast<uint32_t>(words.size());
+        }
+        task_ends[task] = i;
+    });
+    for (size_t task = 0; task < task_count; ++task) {
+        if (task_errors[task]) {
+            valid_count = task_ends[task];
+            error = task_errors[task];
+            break;
+        }
+    }
+    // Logged before they are applied, the documents from a failed append on are not added
+    for (size_t i = 0; i < valid_count; ++i) {
+        const DocumentToAdd& document = documents[i];
+        try {
+            LogAddDocument(document.id, document.text, document.status, document.ratings);
+        } catch (...) {
+            valid_count = i;
+            error = std::current_exception();
+            break;
+        }
+    }
+
+    // Parts cover consecutive documents, so appending them in order keeps every posting list sorted
+    METRIC_STAGE(INGEST_INDEX);
+    const DocOrdinal first_ordinal = static_cast<DocOrdinal>(documents_.size());
+    std::vector<std::vector<TermId>> part_terms(task_count);
+    for (size_t task = 0; task < task_count; ++task) {
+        const PartialIndex& part = parts[task];
+        part_terms[task].resize(part.terms.size(), TermDictionary::NO_TERM);
+        for (size_t local_term = 0; local_term < part.terms.size(); ++local_term) {
+            const auto& postings = part.postings[local_term];
+            if (postings.front().first >= valid_count) {
+                continue;
+            }
+            const TermId term = terms_.Intern(part.terms[local_term]);
+            part_terms[task][local_term] = term;
+            for (const auto& [document, count] : postings) {
+                if (document >= valid_count) {
+                    break;
+                }
+                index_.Add(term, first_ordinal + document, count, document_lengths[document]);
+            }
+            idf_.MarkTermChanged(term);
+        }
+    }
+
+    documents_.reserve(documents_.size() + valid_count);
+    document_term_ends_.reserve(document_term_ends_.size() + valid_count);
+    for (size_t task = 0; task < task_count; ++task) {
+        const PartialIndex& part = parts[task];
+        const size_t begin = task_begin(task);
+        const size_t end = std::min(task_ends[task], valid_count);
+        for (size_t i = begin; i < end; ++i) {
+            const DocumentToAdd& document = documents[i];
+            const size_t terms_begin = i == begin ? 0 : part.document_term_ends[i - begin - 1];
+            for (size_t j = terms_begin; j < part.document_term_ends[i - begin]; ++j) {
+                document_terms_.push_back(part_terms[task][part.document_terms[j]]);
+            }
+            document_term_ends_.push_back(document_terms_.size());
+            documents_.push_back({ document.id, ComputeAverageRating(document.ratings), document.status });
+            document_ordinals_.Insert(document.id, static_cast<DocOrdinal>(first_ordinal + i));
+        }
+    }
+    if (valid_count > 0) {
+        index_.FinishDocuments(static_cast<DocOrdinal>(documents_.size()));
+        idf_.MarkDocumentCountChanged();
+    }
+    METRIC_COUNT(ADDED_DOCUMENTS, valid_count);
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void SearchServer::LogAddDocument(int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    if (log_) {
+        log_->AppendAddDocument(mutation_sequence_ + 1, document_id, document, status, ratings);
+    }
+    ++mutation_sequence_;
+}
+
+void SearchServer::LogRemoveDocument(int document_id) {
+    if (log_) {
+        log_->AppendRemoveDocument(mutation_sequence_ + 1, document_id);
+    }
+    ++mutation_sequence_;
+}
+
+void SearchServer::OpenMutationLog(const std::string& path, const MutationLogOptions& options) {
+    if (log_) {
+        throw std::logic_error("Mutation log is already open"s);
+    }
+    const uint64_t valid_size = MutationLog::Replay(path, [this](const MutationLog::Record& record) {
+        // The snapshot may have been saved before the log was truncated
+        if (record.sequence <= mutation_sequence_) {
+            return;
+        }
+        if (record.type == MutationLog::RecordType::ADD_DOCUMENT) {
+            AddDocument(record.document_id, record.text, record.status, record.ratings);
+        } else {
+            RemoveDocument(record.document_id);
+        }
+        mutation_sequence_ = record.sequence;
+    });
+    log_ = std::make_unique<MutationLog>(path, valid_size, options);
+}
+
+void SearchServer::SyncMutationLog() {
+    if (log_) {
+        log_->Flush();
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    document_ids_.insert(document_id);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+    return FindTopDocuments(raw_query, status, SearchOptions{});
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+    const SearchOptions& options) const {
+    PooledQuery query;
+    ParseQuery(raw_query, *query);
+    return FindTopQueryDocuments(std::execution::seq, *query, status, options);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
-int SearchServer::GetDocumentCount() const {
-    return static_cast<int>(documents_.size());
+SearchServer::PreparedQuery SearchServer::PrepareQuery(std::string_view raw_query) const {
+    PreparedQuery prepared;
+    prepared.text_ = std::string(raw_query);
+    std::vector<QueryWord> missing_words;
+    ParseQuery(raw_query, prepared.query_, &missing_words);
+    for (const auto* terms : { &prepared.query_.plus_terms, &prepared.query_.minus_terms }) {
+        for (const TermId term : *terms) {
+            prepared.words_.emplace_back(terms_.GetTerm(term));
+        }
+    }
+    std::sort(missing_words.begin(), missing_words.end(), [](const QueryWord& lhs, const QueryWord& rhs) {
+        return std::tie(lhs.data, lhs.is_minus) < std::tie(rhs.data, rhs.is_minus);
+    });
+    missing_words.erase(std::unique(missing_words.begin(), missing_words.end(),
+        [](const QueryWord& lhs, const QueryWord& rhs) {
+            return lhs.data == rhs.data && lhs.is_minus == rhs.is_minus;
+        }), missing_words.end());
+    for (const QueryWord& word : missing_words) {
+        prepared.missing_words_.push_back({ std::string(word.data), word.is_minus });
+    }
+    prepared.generation_ = generation_;
+    return prepared;
 }
 
-std::set<int>::const_iterator SearchServer::begin() const {
-    return document_ids_.begin();
+const SearchServer::Query& SearchServer::ResolvePreparedQuery(const PreparedQuery& prepared, Query& query) const {
+    if (prepared.generation_ == generation_) {
+        return prepared.query_;
+    }
+    const size_t plus_count = prepared.query_.plus_terms.size();
+    for (size_t i = 0; i < prepared.words_.size(); ++i) {
+        const TermId term = i < plus_count
+            ? prepared.query_.plus_terms[i] : prepared.query_.minus_terms[i - plus_count];
+        if (term >= terms_.size() || terms_.GetTerm(term) != prepared.words_[i]) {
+            ParseQuery(prepared.text_, query);
+            return query;
+        }
+    }
+    // New documents may have brought the missing words into the index
+    bool is_found = false;
+    for (const auto& word : prepared.missing_words_) {
+        const TermId term = terms_.Find(word.data);
+        if (term == TermDictionary::NO_TERM) {
+            continue;
+        }
+        if (!is_found) {
+            query.plus_terms.assign(prepared.query_.plus_terms.begin(), prepared.query_.plus_terms.end());
+            query.minus_terms.assign(prepared.query_.minus_terms.begin(), prepared.query_.minus_terms.end());
+            is_found = true;
+        }
+        (word.is_minus ? query.minus_terms : query.plus_terms).push_back(term);
+    }
+    if (!is_found) {
+        return prepared.query_;
+    }
+    // The found terms differ from the prepared ones, sorting keeps them distinct
+    std::sort(query.plus_terms.begin(), query.plus_terms.end());
+    std::sort(query.minus_terms.begin(), query.minus_terms.end());
+    return query;
 }
 
-std::set<int>::const_iterator SearchServer::end() const {
-    return document_ids_.end();
+std::vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status,
+    const SearchOptions& options) const {
+    return FindTopDocuments(std::execution::seq, query, status, options);
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    const static std::map<std::string_view, double> empty;
-    if (id_to_words_freqs_.count(document_id)) {
-        return id_to_words_freqs_.at(document_id);
-    }
-    return empty;
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(std::string_view raw_query,
+    DocumentStatus status, const SearchOptions& options) const {
+    return executor_->Async([this, query = std::string(raw_query), status, options] {
+        return FindTopDocuments(std::execution::par, query, status, options);
+    });
 }
 
-void SearchServer::RemoveDocument(int document_id) {
-    SearchServer::RemoveDocument(std::execution::seq, document_id);
+void SearchServer::FindTopDocumentsAsync(std::string_view raw_query, DocumentStatus status,
+    const SearchOptions& options, SearchCallback callback) const {
+    executor_->Submit([this, query = std::string(raw_query), status, options, callback = std::move(callback)] {
+        std::vector<Document> documents;
+        std::exception_ptr error;
+        try {
+            documents = FindTopDocuments(std::execution::par, query, status, options);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        callback(std::move(documents), error);
+    });
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query,
-    int document_id) const {
-    const auto query = ParseQuery(raw_query, 1);
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const std::vector<std::string_view>& raw_queries, DocumentStatus status, const SearchOptions& options) const {
+    METRIC_STAGE(QUERY_BATCH);
+    METRIC_COUNT(QUERIES, raw_queries.size());
+    const size_t result_count = GetResultCount(options);
+    std::vector<Query> queries;
+    queries.reserve(raw_queries.size());
+    for (const std::string_view raw_query : raw_queries) {
+        ParseQuery(raw_query, queries.emplace_back());
+    }
+    CheckCancelled(options);
+    RefreshInverseDocumentFreqs();
+
+    std::vector<std::vector<Document>> found;
+    found.reserve(queries.size());
+    for (size_t begin = 0; begin < queries.size(); begin += MAX_BATCH_QUERIES) {
+        FindBatchDocuments(queries, begin, std::min(queries.size(), begin + MAX_BATCH_QUERIES), status, options,
+            found);
+    }
+    for (auto& documents : found) {
+        SelectTopDocuments(documents, result_count);
+    }
+    return found;
+}
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+namespace {
+
+// Window rows of FindBatchDocuments: the scores of every query, the bit sets of the
+// documents it scored and of the ones excluded from it. The bits are all clear
+// between batches, so a score is only read after it was written in the window
+struct BatchWindow {
+    static constexpr DocOrdinal SIZE = 4096;
+    static constexpr size_t WORDS = SIZE / 64;
+
+    std::vector<double> scores;
+    std::vector<uint64_t> touched;
+    std::vector<uint64_t> excluded;
+    bool in_use = false;
+};
+
+thread_local BatchWindow thread_batch_window;
+
+// Rows reused by all batches running on the current thread, so a batch neither
+// allocates nor clears its scores. If the thread's rows are already taken,
+// temporary ones are used instead
+class PooledBatchWindow {
+public:
+    explicit PooledBatchWindow(size_t query_count)
+        : uncaught_exceptions_(std::uncaught_exceptions()) {
+        if (thread_batch_window.in_use) {
+            temporary_ = std::make_unique<BatchWindow>();
+            window_ = temporary_.get();
+        } else {
+            thread_batch_window.in_use = true;
+            window_ = &thread_batch_window;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { std::vector<std::string_view>{}, documents_.at(document_id).status };
+        // Rows only grow, the new bits are clear
+        if (window_->scores.size() < query_count * BatchWindow::SIZE) {
+            window_->scores.resize(query_count * BatchWindow::SIZE);
+            window_->touched.resize(query_count * BatchWindow::WORDS, 0);
+            window_->excluded.resize(query_count * BatchWindow::WORDS, 0);
         }
     }
 
-    std::vector<std::string_view> matched_words;
-    matched_words.reserve(query.plus_words.size());
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    ~PooledBatchWindow() {
+        if (temporary_) {
+            return;
+        }
+        // A batch interrupted in the middle of a window leaves bits set
+        if (std::uncaught_exceptions() > uncaught_exceptions_) {
+            std::fill(window_->touched.begin(), window_->touched.end(), 0);
+            std::fill(window_->excluded.begin(), window_->excluded.end(), 0);
+        }
+        thread_batch_window.in_use = false;
+    }
+
+    PooledBatchWindow(const PooledBatchWindow&) = delete;
+    PooledBatchWindow& operator=(const PooledBatchWindow&) = delete;
+
+    BatchWindow& operator*() const {
+        return *window_;
+    }
+
+private:
+    int uncaught_exceptions_;
+    std::unique_ptr<BatchWindow> temporary_;
+    BatchWindow* window_;
+};
+
+} // namespace
+
+void SearchServer::FindBatchDocuments(const std::vector<Query>& queries, size_t begin, size_t end,
+    DocumentStatus status, const SearchOptions& options, std::vector<std::vector<Document>>& found) const {
+    const size_t query_count = end - begin;
+    const size_t found_begin = found.size();
+    found.resize(found_begin + query_count);
+
+    // Distinct words of the batch with the queries they occur in
+    struct BatchWord {
+        TermId term;
+        double inverse_document_freq;
+        std::vector<uint32_t> queries;
+    };
+    const auto collect_words = [this, &queries, begin, end](auto get_terms) {
+        std::unordered_map<TermId, std::vector<uint32_t>> term_queries;
+        for (size_t i = begin; i < end; ++i) {
+            for (const TermId term : get_terms(queries[i])) {
+                term_queries[term].push_back(static_cast<uint32_t>(i - begin));
+            }
+        }
+        std::vector<BatchWord> words;
+        words.reserve(term_queries.size());
+        for (auto& [term, word_queries] : term_queries) {
+            words.push_back({ term, ComputeWordInverseDocumentFreq(term), std::move(word_queries) });
+        }
+        // Ordered by term id as in a parsed query, so every document sums up its relevance
+        // in the order FindTopDocuments does and gets exactly the same value
+        std::sort(words.begin(), words.end(), [](const BatchWord& lhs, const BatchWord& rhs) {
+            return lhs.term < rhs.term;
+        });
+        return words;
+    };
+    const auto plus_words = collect_words([](const Query& query) -> const auto& {
+        return query.plus_terms;
+    });
+    const auto minus_words = collect_words([](const Query& query) -> const auto& {
+        return query.minus_terms;
+    });
+    if (plus_words.empty()) {
+        return;
+    }
+
+    // Ordinals are processed in windows, every query sums its scores of the window
+    // in its own row; postings of a word are scanned once for all its queries
+    constexpr DocOrdinal WINDOW_SIZE = BatchWindow::SIZE;
+    constexpr size_t WINDOW_WORDS = BatchWindow::WORDS;
+    PooledBatchWindow window(query_count);
+    auto& window_scores = (*window).scores;
+    auto& window_touched = (*window).touched;
+    auto& window_excluded = (*window).excluded;
+    std::vector<uint32_t> touched_queries;
+    std::vector<char> is_query_touched(query_count, false);
+    std::vector<uint32_t> excluded_queries;
+
+    struct WordCursor {
+        PostingList::Cursor posting;
+        const BatchWord* word;
+    };
+    for (size_t segment_index = 0; segment_index < index_.GetSegmentCount(); ++segment_index) {
+        const auto segment = index_.GetSegment(segment_index);
+        std::vector<WordCursor> plus_cursors;
+        for (const BatchWord& word : plus_words) {
+            if (const PostingList* postings = segment.Find(word.term)) {
+                plus_cursors.push_back({ postings->begin(), &word });
+            }
+        }
+        if (plus_cursors.empty()) {
             continue;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+        std::vector<WordCursor> minus_cursors;
+        for (const BatchWord& word : minus_words) {
+            if (const PostingList* postings = segment.Find(word.term)) {
+                minus_cursors.push_back({ postings->begin(), &word });
+            }
+        }
+
+        while (true) {
+            DocOrdinal window_begin = segment.end;
+            for (const WordCursor& cursor : plus_cursors) {
+                if (!cursor.posting.AtEnd()) {
+                    window_begin = std::min(window_begin, cursor.posting.Document());
+                }
+            }
+            if (window_begin >= segment.end) {
+                break;
+            }
+            CheckCancelled(options);
+            const DocOrdinal window_end = static_cast<DocOrdinal>(
+                std::min<size_t>(segment.end, static_cast<size_t>(window_begin) + WINDOW_SIZE));
+
+            for (WordCursor& cursor : minus_cursors) {
+                auto& posting = cursor.posting;
+                posting.SeekGEQ(window_begin);
+                for (; !posting.AtEnd() && posting.Document() < window_end; posting.Next()) {
+                    const DocOrdinal offset = posting.Document() - window_begin;
+                    for (const uint32_t query : cursor.word->queries) {
+                        uint64_t& excluded = window_excluded[query * WINDOW_WORDS + offset / 64];
+                        if (excluded == 0) {
+                            excluded_queries.push_back(query);
+                        }
+                        excluded |= uint64_t{ 1 } << (offset % 64);
+                    }
+                }
+            }
+
+            for (WordCursor& cursor : plus_cursors) {
+                auto& posting = cursor.posting;
+                const double inverse_document_freq = cursor.word->inverse_document_freq;
+                for (; !posting.AtEnd() && posting.Document() < window_end; posting.Next()) {
+                    const DocOrdinal document = posting.Document();
+                    const size_t deleted_offset = document - segment.begin;
+                    if ((segment.deleted != nullptr && ((segment.deleted[deleted_offset / 64] >> (deleted_offset % 64)) & 1))
+                        || documents_[document].status != status) {
+                        continue;
+                    }
+                    const DocOrdinal offset = document - window_begin;
+                    const uint64_t bit = uint64_t{ 1 } << (offset % 64);
+                    const double relevance = posting.TermFreq() * inverse_document_freq;
+                    for (const uint32_t query : cursor.word->queries) {
+                        const size_t word_index = query * WINDOW_WORDS + offset / 64;
+                        if (window_excluded[word_index] & bit) {
+                            continue;
+                        }
+                        double& score = window_scores[query * WINDOW_SIZE + offset];
+                        if ((window_touched[word_index] & bit) == 0) {
+                            if (!is_query_touched[query]) {
+                                is_query_touched[query] = true;
+                                touched_queries.push_back(query);
+                            }
+                            window_touched[word_index] |= bit;
+                            score = relevance;
+                        } else {
+                            score += relevance;
+                        }
+                    }
+                }
+            }
+
+            for (const uint32_t query : touched_queries) {
+                is_query_touched[query] = false;
+                auto& documents = found[found_begin + query];
+                for (size_t word_index = 0; word_index < WINDOW_WORDS; ++word_index) {
+                    uint64_t& touched = window_touched[query * WINDOW_WORDS + word_index];
+                    for (; touched != 0; touched &= touched - 1) {
+                        const DocOrdinal offset = static_cast<DocOrdinal>(word_index * 64 + __builtin_ctzll(touched));
+                        const auto& document_data = documents_[window_begin + offset];
+                        documents.push_back({ document_data.id, window_scores[query * WINDOW_SIZE + offset],
+                            document_data.rating });
+                    }
+                }
+            }
+            touched_queries.clear();
+            for (const uint32_t query : excluded_queries) {
+                std::fill(window_excluded.begin() + query * WINDOW_WORDS,
+                    window_excluded.begin() + (query + 1) * WINDOW_WORDS, 0);
+            }
+            excluded_queries.clear();
         }
     }
-    return { matched_words, documents_.at(document_id).status };
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&,
-    std::string_view raw_query, int document_id) const {
-    return MatchDocument(raw_query, document_id);
+void SearchServer::SetResultCache(std::shared_ptr<QueryResultCache> result_cache) {
+    result_cache_ = std::move(result_cache);
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy&,
-    std::string_view raw_query, int document_id) const {
+uint64_t SearchServer::NextGeneration() {
+    static std::atomic<uint64_t> last_generation = 0;
+    return last_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+std::string SearchServer::MakeResultCacheKey(const Query& query, DocumentStatus status,
+    const SearchOptions& options) {
+    // Counts, status and result count, then the term ids, all as raw bytes
+    const uint32_t header[] = { static_cast<uint32_t>(query.plus_terms.size()),
+        static_cast<uint32_t>(query.minus_terms.size()), static_cast<uint32_t>(status),
+        static_cast<uint32_t>(options.max_result_count) };
+    std::string key(reinterpret_cast<const char*>(header), sizeof(header));
+    key.append(reinterpret_cast<const char*>(query.plus_terms.data()), query.plus_terms.size() * sizeof(TermId));
+    key.append(reinterpret_cast<const char*>(query.minus_terms.data()), query.minus_terms.size() * sizeof(TermId));
+    return key;
+}
+
+void SearchServer::SetQueryExecutor(std::shared_ptr<QueryExecutor> executor) {
+    if (!executor) {
+        throw std::invalid_argument("Query executor is null"s);
+    }
+    executor_ = std::move(executor);
+}
+
+int SearchServer::GetDocumentCount() const {
+    return static_cast<int>(document_ordinals_.size());
+}
+
+const IndexOptions& SearchServer::GetIndexOptions() const {
+    return index_.GetOptions();
+}
+
+size_t SearchServer::GetIndexMemoryUsage() const {
+    return index_.MemoryUsage();
+}
 
-    const auto query = ParseQuery(raw_query);
+void SearchServer::WaitForIndexMerges() {
+    index_.WaitForMerges();
+}
+
+DocumentIdMap::Iterator SearchServer::begin() const {
+    return document_ordinals_.begin();
+}
 
-    if (std::any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-        [this, document_id](const std::string_view& word) {
-            return (word_to_document_freqs_.count(word) != 0) &&
-                (word_to_document_freqs_.at(word).count(document_id) > 0);
-        })) {
-        return { std::vector<std::string_view>{}, documents_.at(document_id).status };
+DocumentIdMap::Iterator SearchServer::end() const {
+    return document_ordinals_.end();
+}
+
+DocOrdinal SearchServer::GetOrdinal(int document_id) const {
+    const auto ordinal = document_ordinals_.Find(document_id);
+    if (!ordinal) {
+        throw std::out_of_range("Invalid document_id"s);
     }
+    return *ordinal;
+}
 
-    std::vector<std::string_view> matched_words(query.plus_words.size());
+const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
+    const static std::map<std::string_view, double> empty;
+    const auto ordinal = document_ordinals_.Find(document_id);
+    if (!ordinal) {
+        return empty;
+    }
+    std::lock_guard guard(word_frequencies_guard_);
+    const auto [it, inserted] = id_to_words_freqs_.try_emplace(document_id);
+    if (inserted) {
+        const auto [terms_begin, terms_end] = GetDocumentTerms(*ordinal);
+        for (const TermId* term = terms_begin; term != terms_end; ++term) {
+            it->second.emplace(terms_.GetTerm(*term), 0);
+        }
+    }
+    return it->second;
+}
 
-    auto last_copy = std::copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-        matched_words.begin(),
-        [this, document_id](const std::string_view& word) {
-            return (word_to_document_freqs_.count(word) != 0) &&
-                (word_to_document_freqs_.at(word).count(document_id) > 0);
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    // The snapshot replaces the file only once it is completely written
+    const std::string temporary_path = path + ".tmp"s;
+    {
+        std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+        SnapshotWriter writer(out);
+        writer.WriteStrings(stop_words_);
+        const IndexOptions& index_options = index_.GetOptions();
+        writer.Write(static_cast<uint32_t>(index_options.posting_format));
+        writer.Write(static_cast<uint64_t>(index_options.segment_posting_count));
+        writer.Write(static_cast<uint64_t>(index_options.merge_factor));
+        writer.Write(index_options.vacuum_deleted_share);
+        writer.Write(mutation_sequence_);
+        terms_.Save(writer);
+        index_.Save(writer);
+        writer.WriteArray(documents_);
+        std::vector<int> ids;
+        std::vector<DocOrdinal> ordinals;
+        ids.reserve(document_ordinals_.size());
+        ordinals.reserve(document_ordinals_.size());
+        document_ordinals_.ForEach([&ids, &ordinals](int id, DocOrdinal ordinal) {
+            ids.push_back(id);
+            ordinals.push_back(ordinal);
         });
+        writer.WriteArray(ids);
+        writer.WriteArray(ordinals);
+        writer.WriteArray(document_terms_);
+        writer.WriteArray(document_term_ends_);
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("Cannot write snapshot "s + path);
+        }
+    }
+    SyncFile(temporary_path);
+    std::filesystem::rename(temporary_path, path);
+    const auto directory = std::filesystem::path(path).parent_path();
+    SyncFile(directory.empty() ? "."s : directory.string());
+    // Every logged mutation is in the snapshot now
+    if (log_) {
+        log_->Truncate();
+    }
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+    return SearchServer(SnapshotReader(std::make_shared<const MappedFile>(path)));
+}
+
+namespace {
+
+IndexOptions ReadIndexOptions(SnapshotReader& reader) {
+    const auto format = reader.Read<uint32_t>();
+    if (format > static_cast<uint32_t>(PostingFormat::COMPRESSED)) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    IndexOptions options(static_cast<PostingFormat>(format));
+    options.segment_posting_count = static_cast<size_t>(reader.Read<uint64_t>());
+    options.merge_factor = static_cast<size_t>(reader.Read<uint64_t>());
+    options.vacuum_deleted_share = reader.Read<double>();
+    return options;
+}
+
+std::set<std::string, std::less<>> ReadStopWords(SnapshotReader& reader) {
+    const auto stop_words = reader.ReadStrings();
+    return { stop_words.begin(), stop_words.end() };
+}
+
+} // namespace
+
+// Members are initialized in declaration order, which is the order of the snapshot sections
+SearchServer::SearchServer(SnapshotReader&& reader)
+    : snapshot_(reader.GetFile())
+    , stop_words_(ReadStopWords(reader))
+    , index_(ReadIndexOptions(reader))
+{
+    mutation_sequence_ = reader.Read<uint64_t>();
+    terms_.Load(reader);
+    index_.Load(reader, terms_.size());
+    documents_ = reader.ReadArray<DocumentData>();
+    const auto ids = reader.ReadArray<int>();
+    const auto ordinals = reader.ReadArray<DocOrdinal>();
+    document_terms_ = reader.ReadArray<TermId>();
+    document_term_ends_ = reader.ReadArray<uint64_t>();
+    if (ids.size() != ordinals.size() || document_term_ends_.size() != documents_.size()
+        || index_.GetEnd() != documents_.size()
+        || (!document_term_ends_.empty() && document_term_ends_.back() != document_terms_.size())
+        || !std::is_sorted(document_term_ends_.begin(), document_term_ends_.end())
+        || std::any_of(document_terms_.begin(), document_terms_.end(), [this](TermId term) {
+               return term >= terms_.size();
+           })) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+
+    // Ids are sorted, so every one is appended to the last chunk
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ordinals[i] >= documents_.size() || !document_ordinals_.Insert(ids[i], ordinals[i])) {
+            throw std::runtime_error("Snapshot is corrupted"s);
+        }
+    }
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        idf_.MarkTermChanged(term);
+    }
+    idf_.MarkDocumentCountChanged();
+}
+
+void SearchServer::RemoveDocument(int document_id) {
+    SearchServer::RemoveDocument(std::execution::seq, document_id);
+}
+
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    for (const int document_id : document_ids) {
+        RemoveDocument(document_id);
+    }
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query,
+    int document_id) const {
+    PooledQuery pooled_query;
+    Query& query = *pooled_query;
+    ParseQuery(raw_query, query);
+    const DocOrdinal ordinal = GetOrdinal(document_id);
+
+    for (const TermId term : query.minus_terms) {
+        if (index_.Contains(term, ordinal)) {
+            return { std::vector<std::string_view>{}, documents_[ordinal].status };
+        }
+    }
 
-    std::sort(matched_words.begin(), last_copy, [](const auto& lhs, const auto& rhs) {
+    std::vector<std::string_view> matched_words;
+    for (const TermId term : query.plus_terms) {
+        if (index_.Contains(term, ordinal)) {
+            // Return the view into the dictionary, not into raw_query
+            matched_words.push_back(terms_.GetTerm(term));
+        }
+    }
+    std::sort(matched_words.begin(), matched_words.end(), [](const auto& lhs, const auto& rhs) {
         return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
         });
-    auto last = std::unique(matched_words.begin(), last_copy);
-    matched_words.erase(last, matched_words.end());
-
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, documents_[ordinal].status };
 }
 
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&,
+    std::string_view raw_query, int document_id) const {
+    return MatchDocument(raw_query, document_id);
+}
 
-std::string_view SearchServer::ValidateView(std::string_view word) {
-    heap_strings_.push_back(static_cast<std::string>(word));
-    return heap_strings_.back();
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy&,
+    std::string_view raw_query, int document_id) const {
+    // A word is looked up in a few microseconds, so the words are not worth splitting between threads
+    return MatchDocument(raw_query, document_id);
 }
 
+
 bool SearchServer::IsStopWord(std::string_view word) const {
     return stop_words_.count(word) > 0;
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const auto& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word "s + static_cast<std::string>(word) + " is invalid"s);
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+void SearchServer::SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const {
+    METRIC_STAGE(INGEST_TOKENIZE);
+    if (!SplitIntoWords(text, words)) {
+        // The tokenizer only tells that the text has control characters, find the word to report
+        for (const std::string_view word : words) {
+            if (!IsValidWord(word)) {
+                throw std::invalid_argument("Word "s + static_cast<std::string>(word) + " is invalid"s);
+            }
         }
     }
-    return words;
+    if (!stop_words_.empty()) {
+        words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) {
+            return IsStopWord(word);
+        }), words.end());
+    }
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) {
     if (text.empty()) {
         throw std::invalid_argument("Query word is empty"s);
     }
@@ -178,46 +884,136 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
         is_minus = true;
         word = word.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    if (word.empty() || word[0] == '-') {
         throw std::invalid_argument("Query word "s + (std::string)text + " is invalid");
     }
 
-    return { word, is_minus, IsStopWord(word) };
+    return { word, is_minus };
 }
 
-void SearchServer::EraseUnique(SearchServer::Query& query) const {
-    std::sort(query.minus_words.begin(), query.minus_words.end(), [](const auto& lhs, const auto& rhs) {
-        return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
-        });
-    auto last_minus = std::unique(query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(last_minus, query.minus_words.end());
+std::vector<SearchServer::QueryPostings> SearchServer::FindQueryPostings(const Query& query) const {
+    METRIC_STAGE(QUERY_LOOKUP);
+    RefreshInverseDocumentFreqs();
+    std::vector<QueryPostings> result;
+    if (query.plus_terms.empty()) {
+        return result;
+    }
+    for (size_t i = 0; i < index_.GetSegmentCount(); ++i) {
+        const auto segment = index_.GetSegment(i);
+        QueryPostings postings{ segment.begin, segment.end, segment.deleted };
+        for (const TermId term : query.plus_terms) {
+            if (const PostingList* word_postings = segment.Find(term)) {
+                postings.plus.push_back({ term, word_postings });
+                postings.plus_volume += word_postings->size();
+            }
+        }
+        if (postings.plus.empty()) {
+            continue;
+        }
+        for (const TermId term : query.minus_terms) {
+            if (const PostingList* word_postings = segment.Find(term)) {
+                postings.minus.push_back({ term, word_postings });
+                postings.minus_volume += word_postings->size();
+            }
+        }
+        METRIC_COUNT(POSTINGS, postings.plus_volume + postings.minus_volume);
+        result.push_back(std::move(postings));
+    }
+    return result;
+}
 
-    std::sort(query.plus_words.begin(), query.plus_words.end(), [](const auto& lhs, const auto& rhs) {
-        return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
-        });
-    auto last_plus = std::unique(query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(last_plus, query.plus_words.end());
+void SearchServer::FindExcludedInRange(const QueryPostings& postings, DocOrdinal begin, DocOrdinal end,
+    ExclusionSet& excluded) const {
+    METRIC_STAGE(QUERY_MINUS_FILTER);
+    const size_t range_volume = static_cast<size_t>(
+        static_cast<double>(postings.minus_volume) * (end - begin) / (postings.end - postings.begin));
+    excluded.Reset(begin, end, range_volume, postings.deleted, postings.begin);
+    for (const auto& [term, word_postings] : postings.minus) {
+        auto posting = word_postings->begin();
+        posting.SeekGEQ(begin);
+        for (; !posting.AtEnd() && posting.Document() < end; posting.Next()) {
+            excluded.Add(posting.Document());
+        }
+    }
+    excluded.Seal();
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+void SearchServer::SelectTopDocuments(std::vector<Document>& documents, size_t top_count) {
+    if (documents.size() > top_count) {
+        std::partial_sort(documents.begin(), documents.begin() + top_count, documents.end(), IsMoreRelevant);
+        documents.resize(top_count);
+    } else {
+        std::sort(documents.begin(), documents.end(), IsMoreRelevant);
+    }
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::string_view text, bool there_duplicates) const {
-    Query result;
-    for (const auto& word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
+void SearchServer::CheckCancelled(const SearchOptions& options) {
+    if (options.cancellation && options.cancellation->IsCancelled()) {
+        throw QueryCancelled("Query is cancelled"s);
+    }
+    if (options.deadline != std::chrono::steady_clock::time_point::max()
+        && std::chrono::steady_clock::now() >= options.deadline) {
+        throw QueryCancelled("Query deadline is exceeded"s);
+    }
+}
+
+size_t SearchServer::GetResultCount(const SearchOptions& options) {
+    if (options.max_result_count < 0) {
+        throw std::invalid_argument("Result count must not be negative"s);
+    }
+    return static_cast<size_t>(options.max_result_count);
+}
+
+void SearchServer::ParseQuery(std::string_view text, Query& query, std::vector<QueryWord>* missing_words) const {
+    METRIC_STAGE(QUERY_PARSE);
+    // Reused by every query the thread parses, parsing never nests
+    thread_local std::vector<std::string_view> words;
+    if (!SplitIntoWords(text, words)) {
+        for (const std::string_view word : words) {
+            if (!IsValidWord(word)) {
+                throw std::invalid_argument("Query word "s + static_cast<std::string>(word) + " is invalid"s);
             }
-            else {
-                result.plus_words.push_back(query_word.data);
+        }
+    }
+    query.plus_terms.clear();
+    query.minus_terms.clear();
+    for (const std::string_view word : words) {
+        const auto query_word = ParseQueryWord(word);
+        // Stop words are never added to the dictionary, so one lookup drops them
+        // along with the words no document has
+        const TermId term = terms_.Find(query_word.data);
+        if (term == TermDictionary::NO_TERM) {
+            if (missing_words) {
+                missing_words->push_back(query_word);
             }
+            continue;
         }
+        (query_word.is_minus ? query.minus_terms : query.plus_terms).push_back(term);
     }
-    if (there_duplicates) {
-        EraseUnique(result);
+    for (auto* terms : { &query.plus_terms, &query.minus_terms }) {
+        std::sort(terms->begin(), terms->end());
+        terms->erase(std::unique(terms->begin(), terms->end()), terms->end());
+    }
+}
+
+SearchServer::PooledQuery::Slot& SearchServer::PooledQuery::GetThreadSlot() {
+    thread_local Slot slot;
+    return slot;
+}
+
+SearchServer::PooledQuery::PooledQuery() {
+    Slot& slot = GetThreadSlot();
+    if (slot.in_use) {
+        temporary_ = std::make_unique<Query>();
+        query_ = temporary_.get();
+    } else {
+        slot.in_use = true;
+        query_ = &slot.query;
+    }
+}
+
+SearchServer::PooledQuery::~PooledQuery() {
+    if (!temporary_) {
+        GetThreadSlot().in_use = false;
     }
-    return result;
 }
\ No newline at end of file
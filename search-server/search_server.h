@@ -1,8 +1,12 @@
 #pragma once
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <stdexcept>
 #include <numeric>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <string_view>
@@ -11,9 +15,13 @@
 #include <tuple>
 #include <deque>
 #include <execution>
+#include <functional>
 #include <future>
+#include <limits>
+#include <thread>
 #include <mutex>
 #include <type_traits>
+#include <unordered_map>
 
 class SearchServer;
 
@@ -21,7 +29,20 @@ class SearchServer;
 #include "read_input_functions.h"
 #include "string_processing.h"
 #include "process_queries.h" // Here used object of class SearchServer, need class declaration
-#include "concurrent_map.h"
+#include "term_dictionary.h"
+#include "pod_buffer.h"
+#include "inverted_index.h"
+#include "segmented_index.h"
+#include "exclusion_set.h"
+#include "snapshot.h"
+#include "mutation_log.h"
+#include "score_accumulator.h"
+#include "idf_table.h"
+#include "document_id_map.h"
+#include "query_executor.h"
+#include "query_cancellation.h"
+#include "result_cache.h"
+#include "metrics.h"
 
 #include "log_duration.h"
 
@@ -30,30 +51,71 @@ using namespace std::string_view_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// Способ вычисления результатов запроса
+enum class QueryEvaluation {
+    // Релевантность считается для каждого документа со словами запроса
+    EXHAUSTIVE,
+    // Документы, которые не могут попасть в результат, пропускаются (MaxScore)
+    MAX_SCORE,
+};
+
+// Параметры выполнения поискового запроса
+struct SearchOptions {
+    // Сколько лучших документов вернуть
+    int max_result_count = MAX_RESULT_DOCUMENT_COUNT;
+    QueryEvaluation evaluation = QueryEvaluation::EXHAUSTIVE;
+    // Запрос прерывается исключением QueryCancelled, если не завершился к этому сроку
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // или если вызывающий отменил его
+    std::shared_ptr<QueryCancellation> cancellation = nullptr;
+};
+
+// Документ для пакетного добавления в поисковую систему
+struct DocumentToAdd {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
+
 class SearchServer {
 public:
+    // index_options задает способ хранения индекса, быстрее или компактнее, и размеры его сегментов
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words)
+    explicit SearchServer(const StringContainer& stop_words, const IndexOptions& index_options = {})
         : stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
+        , index_(index_options)
     {
         if (!std::all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
             throw std::invalid_argument("Some of stop words are invalid"s);
         }
     }
 
-    explicit SearchServer(std::string_view stop_words_text)
+    explicit SearchServer(std::string_view stop_words_text, const IndexOptions& index_options = {})
         : SearchServer(
-            SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+            SplitIntoWords(stop_words_text), index_options)  // Invoke delegating constructor from string container
     {}
 
-    explicit SearchServer(const std::string& stop_words_text)
+    explicit SearchServer(const std::string& stop_words_text, const IndexOptions& index_options = {})
         : SearchServer(
-            SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
+            SplitIntoWords(stop_words_text), index_options)  // Invoke delegating constructor from string container
     {}
 
+    // Копия разделяет с оригиналом данные индекса, пока одна из них их не изменит.
+    // Журнал изменений копией не наследуется
+    SearchServer(const SearchServer& other);
+    SearchServer& operator=(const SearchServer&) = delete;
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status,
         const std::vector<int>& ratings);
 
+    // Пакетное добавление: слова документов разбираются параллельно, индекс пополняется за один проход.
+    // Как и при вызовах AddDocument по очереди, документы до первого некорректного добавляются,
+    // после чего выбрасывается исключение
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
+    void AddDocuments(const std::execution::sequenced_policy&, const std::vector<DocumentToAdd>& documents);
+    void AddDocuments(const std::execution::parallel_policy&, const std::vector<DocumentToAdd>& documents);
+
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
@@ -68,19 +130,95 @@ public:
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const;
 
+    // Поиск с параметрами, например, с заданным количеством результатов
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+        const SearchOptions& options) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        const SearchOptions& options) const;
+
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+        DocumentPredicate document_predicate, const SearchOptions& options) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+        DocumentStatus status, const SearchOptions& options) const;
+
+    // Пакетный поиск: каждое слово пакета ищется в индексе один раз, и его список документов
+    // просматривается один раз для всех запросов пакета. Результаты те же, что у FindTopDocuments
+    // для каждого запроса; релевантность всегда считается полным перебором
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string_view>& raw_queries,
+        DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+
+    // Пул потоков для параллельного поиска и ProcessQueries, по умолчанию общий для всех поисковых систем.
+    // Копии поисковой системы пользуются тем же пулом
+    void SetQueryExecutor(std::shared_ptr<QueryExecutor> executor);
+    const std::shared_ptr<QueryExecutor>& GetQueryExecutor() const {
+        return executor_;
+    }
+
+    // Асинхронный поиск в пуле потоков поисковой системы, результат или исключение передается через future.
+    // Текст запроса копируется, поисковая система должна существовать до завершения поиска.
+    // Пока очередь пула заполнена, вызов ждет места в ней. Отмененный или просроченный запрос
+    // освобождает поток при ближайшей проверке, а еще не начатый - сразу
+    std::future<std::vector<Document>> FindTopDocumentsAsync(std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+
+    // callback вызывается в потоке пула с результатом либо с исключением и не должен выбрасывать исключений
+    using SearchCallback = std::function<void(std::vector<Document> documents, std::exception_ptr error)>;
+    void FindTopDocumentsAsync(std::string_view raw_query, DocumentStatus status, const SearchOptions& options,
+        SearchCallback callback) const;
+
+    // Кэш результатов запросов с фильтром по статусу, по умолчанию его нет. Любое изменение поисковой
+    // системы делает ее прежние результаты в кэше недействительными. Копии пользуются тем же кэшем
+    void SetResultCache(std::shared_ptr<QueryResultCache> result_cache);
+    const std::shared_ptr<QueryResultCache>& GetResultCache() const {
+        return result_cache_;
+    }
+
     int GetDocumentCount() const;
 
+    // Параметры индекса, с которыми создана поисковая система или сохранен ее снимок
+    const IndexOptions& GetIndexOptions() const;
+
+    // Объем памяти, занимаемой списками документов слов, в байтах
+    size_t GetIndexMemoryUsage() const;
+
+    // Сегменты индекса сливаются в фоновом потоке и подменяются при следующем изменении.
+    // Метод дожидается всех слияний и применяет их
+    void WaitForIndexMerges();
+
     // Методы begin() и end() дают возвращают итераторы к контейнеру id документов поисковой системы
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    DocumentIdMap::Iterator begin() const;
+    DocumentIdMap::Iterator end() const;
 
     // Получение частот слов по id документа
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
-    // Удаление документа из поискового сервера
+    // Сохранение состояния поисковой системы в двоичный снимок.
+    // Если открыт журнал изменений, вошедшие в снимок записи из него удаляются
+    void SaveSnapshot(const std::string& path) const;
+    // Загрузка снимка: файл отображается в память, списки документов и слова читаются прямо из него.
+    // Параметры индекса восстанавливаются из снимка
+    static SearchServer LoadSnapshot(const std::string& path);
+
+    // Применяет к поисковой системе изменения из журнала, которых нет в загруженном снимке,
+    // и дописывает в журнал все последующие добавления и удаления документов. Изменение
+    // записывается в журнал до применения: если журнал его не принял, выбрасывается runtime_error,
+    // а поисковая система остается без него. Записанное изменение сохранено на диске только
+    // после SyncMutationLog
+    void OpenMutationLog(const std::string& path, const MutationLogOptions& options = {});
+    // Дожидается записи журнала на диск
+    void SyncMutationLog();
+
+    // Удаление документа из поискового сервера. Документ помечается удаленным в своем сегменте индекса,
+    // поэтому время удаления не зависит от того, сколько документов содержат его слова
     void RemoveDocument(int document_id);
     template<class ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
+    // Удаление нескольких документов. Как и при вызовах RemoveDocument по очереди,
+    // документы до первого отсутствующего удаляются, после чего выбрасывается исключение
+    void RemoveDocuments(const std::vector<int>& document_ids);
 
     using MatchWordsStatus = std::tuple<std::vector<std::string_view>, DocumentStatus>;
 
@@ -90,25 +228,90 @@ public:
     MatchWordsStatus MatchDocument(const std::execution::parallel_policy&, std::string_view raw_query,
         int document_id) const;
 
+    // Запрос, разобранный для многократного выполнения
+    class PreparedQuery;
+
+    // Разбирает и проверяет запрос один раз, слова запроса сопоставляются словам поисковой системы.
+    // На этой поисковой системе и ее копиях запрос не разбирается заново, даже если они изменились
+    // после подготовки: ищутся только слова, которых тогда не было. На другой поисковой системе
+    // запрос разбирается при каждом выполнении
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status = DocumentStatus::ACTUAL,
+        const SearchOptions& options = {}) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const PreparedQuery& query,
+        DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+
 
 private:
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
     };
 
-    // Contains string for string_view to don`t invalidate
-    std::deque<std::string> heap_strings_;
+    // Loaded snapshot, buffers below may borrow its memory
+    std::shared_ptr<const MappedFile> snapshot_;
+
+    // Single copy of every unique word, all string_view below point into it
+    TermDictionary terms_;
 
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
-    std::map<int, std::map<std::string_view, double>> id_to_words_freqs_;
+    // Postings reference documents by ordinal, documents_ is indexed by it
+    SegmentedIndex index_;
+    IdfTable idf_;
+    std::shared_ptr<QueryExecutor> executor_ = QueryExecutor::GetDefault();
+    std::shared_ptr<QueryResultCache> result_cache_;
+    // Unique among all search servers of the process: a copy shares it until either is changed,
+    // so equal generations mean equal results
+    uint64_t generation_ = NextGeneration();
+
+    static uint64_t NextGeneration();
+    PodBuffer<DocumentData> documents_;
+    DocumentIdMap document_ordinals_;
+    // Terms of every document by ordinal, the ones of ordinal i end at document_term_ends_[i]
+    PodBuffer<TermId> document_terms_;
+    PodBuffer<uint64_t> document_term_ends_;
+    // Word sets returned by GetWordFrequencies, built from document_terms_ on the first request
+    mutable std::mutex word_frequencies_guard_;
+    mutable std::map<int, std::map<std::string_view, double>> id_to_words_freqs_;
+
+    // Number of the last applied mutation, saved in snapshots to skip the logged ones they contain
+    uint64_t mutation_sequence_ = 0;
+    std::unique_ptr<MutationLog> log_;
+
+    // Numbers the mutation and appends it to the log if one is open
+    void LogAddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    void LogRemoveDocument(int document_id);
 
-    // Save string_view inside the object to they don't invalidate
-    // Return new string_view, which deleted together with class object
-    std::string_view ValidateView(std::string_view word);
+    explicit SearchServer(SnapshotReader&& reader);
+
+    // Throws std::out_of_range if there is no document with the id
+    DocOrdinal GetOrdinal(int document_id) const;
+
+    // Terms the document with the ordinal contains, each one once
+    std::pair<const TermId*, const TermId*> GetDocumentTerms(DocOrdinal ordinal) const {
+        const uint64_t begin = ordinal == 0 ? 0 : document_term_ends_[ordinal - 1];
+        return { document_terms_.data() + begin, document_terms_.data() + document_term_ends_[ordinal] };
+    }
+
+    // Documents of a batch tokenized by one worker into its own small index,
+    // so workers share nothing until the postings are merged into index_
+    struct PartialIndex {
+        std::unordered_map<std::string_view, uint32_t> term_ids;
+        std::vector<std::string_view> terms;
+        // Per local term: index of the document in the batch and count of the term in it
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> postings;
+        // Local terms of every document, the ones of the i-th document end at document_term_ends[i]
+        std::vector<uint32_t> document_terms;
+        std::vector<size_t> document_term_ends;
+    };
+
+    // Parallel ingestion splits a batch into parts of at least this many documents
+    static constexpr size_t MIN_DOCUMENTS_PER_TASK = 256;
+
+    void AddDocumentsInParts(const std::vector<DocumentToAdd>& documents, size_t task_count);
 
     bool IsStopWord(std::string_view word) const;
 
@@ -119,7 +322,8 @@ private:
             });
     }
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // Writes the words of the text except stop words to words, reusing its memory
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings) {
         if (ratings.empty()) {
@@ -132,92 +336,258 @@ private:
     struct QueryWord {
         std::string_view data;
         bool is_minus;
-        bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // Checks the syntax of the word, not its characters
+    static QueryWord ParseQueryWord(std::string_view text);
 
+    // Distinct term ids of the query words present in the index, ascending. Every search
+    // sums the relevance of a document in this order, so all of them get exactly the same value
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        std::vector<TermId> plus_terms;
+        std::vector<TermId> minus_terms;
+    };
+
+    // Overwrites query, reusing its memory. The words the dictionary does not have,
+    // stop words among them, are added to missing_words if it is given
+    void ParseQuery(std::string_view text, Query& query, std::vector<QueryWord>* missing_words = nullptr) const;
+
+    // Query to run for the prepared one: its own if the term ids are valid for this
+    // server and it has no new words, otherwise the one written to query
+    const Query& ResolvePreparedQuery(const PreparedQuery& prepared, Query& query) const;
+
+    // Query reused by all searches running on the current thread, so steady-state
+    // parsing does not allocate. A nested search gets a temporary one instead
+    class PooledQuery {
+    public:
+        PooledQuery();
+        ~PooledQuery();
+
+        PooledQuery(const PooledQuery&) = delete;
+        PooledQuery& operator=(const PooledQuery&) = delete;
+
+        Query& operator*() const {
+            return *query_;
+        }
+
+    private:
+        struct Slot {
+            Query query;
+            bool in_use = false;
+        };
+
+        static Slot& GetThreadSlot();
+
+        std::unique_ptr<Query> temporary_;
+        Query* query_;
+    };
+
+    // Reads the IDF cache, which must be refreshed by RefreshInverseDocumentFreqs first
+    double ComputeWordInverseDocumentFreq(TermId term) const {
+        return idf_.Get(term);
+    }
+
+    // Applies index changes since the last query to the IDF cache
+    void RefreshInverseDocumentFreqs() const {
+        idf_.Refresh(index_, document_ordinals_.size());
+    }
+
+    // Copies start with an up-to-date cache, so a copy taken after every change does not recompute all of it
+    const IdfTable& GetRefreshedInverseDocumentFreqs() const {
+        RefreshInverseDocumentFreqs();
+        return idf_;
+    }
+
+    struct WordPostings {
+        TermId term;
+        const PostingList* postings;
     };
 
-    void EraseUnique(Query& result) const;
-    Query ParseQuery(std::string_view text, bool there_duplicates = 0) const;
+    // Posting lists of the query in one segment of the index
+    struct QueryPostings {
+        DocOrdinal begin = 0;
+        DocOrdinal end = 0;
+        // Documents removed from the segment, see SegmentedIndex::SegmentView
+        const uint64_t* deleted = nullptr;
+        std::vector<WordPostings> plus = {};
+        std::vector<WordPostings> minus = {};
+        // Total count of plus-word postings
+        size_t plus_volume = 0;
+        // Total count of minus-word postings
+        size_t minus_volume = 0;
+    };
+
+    // Looks up the posting lists of the query in the segments having any of its plus
+    // words and refreshes the IDF cache
+    std::vector<QueryPostings> FindQueryPostings(const Query& query) const;
+
+    // Collects the documents in [begin, end) containing any minus word of the query
+    void FindExcludedInRange(const QueryPostings& postings, DocOrdinal begin, DocOrdinal end,
+        ExclusionSet& excluded) const;
+
+    // Batch search scores at most this many queries at once, each one has its own window of scores
+    static constexpr size_t MAX_BATCH_QUERIES = 128;
+
+    // Scores queries [begin, end) of the batch and appends their results to found
+    void FindBatchDocuments(const std::vector<Query>& queries, size_t begin, size_t end, DocumentStatus status,
+        const SearchOptions& options, std::vector<std::vector<Document>>& found) const;
+
+    // Parallel search splits segments into ranges of at least this many postings of the query
+    static constexpr size_t MIN_POSTINGS_PER_TASK = 1 << 14;
+
+    // Scores documents with ordinals in [begin, end) and appends them to matched_documents
+    template <typename DocumentPredicate>
+    void FindDocumentsInRange(const QueryPostings& postings, DocumentPredicate& document_predicate,
+        DocOrdinal begin, DocOrdinal end, size_t posting_volume, const SearchOptions& options,
+        std::vector<Document>& matched_documents) const;
+
+    // MaxScore evaluation over ordinals [begin, end). Keeps the documents that
+    // can be among the top_count best ones, skipping those whose upper bound
+    // of relevance is below the current top_count-th best relevance.
+    // top_relevances is the min-heap of the best relevances found so far, ranges
+    // scored one after another share it so that later ones start pruning at once
+    template <typename DocumentPredicate>
+    void FindTopDocumentsInRange(const QueryPostings& postings, DocumentPredicate& document_predicate,
+        DocOrdinal begin, DocOrdinal end, size_t top_count, std::vector<double>& top_relevances,
+        const SearchOptions& options, std::vector<Document>& matched_documents) const;
+
+    // Documents for the query in [begin, end): all matched ones for exhaustive
+    // evaluation, a superset of the top_count best ones for MaxScore, see FindTopDocumentsInRange
+    template <typename DocumentPredicate>
+    void FindCandidatesInRange(const QueryPostings& postings, DocumentPredicate& document_predicate,
+        DocOrdinal begin, DocOrdinal end, size_t top_count, std::vector<double>& top_relevances,
+        const SearchOptions& options, std::vector<Document>& matched_documents) const;
+
+    // Top documents of a parsed query
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopQueryDocuments(ExecutionPolicy&& policy, const Query& query,
+        DocumentPredicate document_predicate, const SearchOptions& options) const;
+    // Same with a status filter, served from the result cache if there is one
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopQueryDocuments(ExecutionPolicy&& policy, const Query& query,
+        DocumentStatus status, const SearchOptions& options) const;
 
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    // Key of the parsed query, so word order, duplicates and words missing from the index do not matter
+    static std::string MakeResultCacheKey(const Query& query, DocumentStatus status, const SearchOptions& options);
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate,
+        size_t top_count, const SearchOptions& options) const;
 
+    // Every worker keeps only its top_count best documents, so less has to be merged
     template <typename DocumentPredicate, typename ExecutionPolicy>
     std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, size_t top_count, const SearchOptions& options) const;
+
+    // Order of the search results: by relevance, equal relevance by rating.
+    // Fully equal documents go by id, so every evaluation returns the same top
+    static bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+        const double EPSILON = 1e-6;
+        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+            if (lhs.rating == rhs.rating) {
+                return lhs.id < rhs.id;
+            }
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.relevance > rhs.relevance;
+    }
+
+    // Leaves the top_count best documents sorted, without sorting the rest
+    static void SelectTopDocuments(std::vector<Document>& documents, size_t top_count);
+
+    static size_t GetResultCount(const SearchOptions& options);
+
+    // Throws QueryCancelled once the query is cancelled or past its deadline
+    static void CheckCancelled(const SearchOptions& options);
+};
+
+class SearchServer::PreparedQuery {
+public:
+    PreparedQuery() = default;
+
+    // Текст запроса
+    const std::string& GetText() const {
+        return text_;
+    }
+
+private:
+    friend class SearchServer;
+
+    struct MissingWord {
+        std::string data;
+        bool is_minus;
+    };
+
+    std::string text_;
+    Query query_;
+    // Words of query_.plus_terms followed by those of query_.minus_terms. Term ids
+    // never change, so they are compared only to tell a server with another dictionary
+    std::vector<std::string> words_;
+    // Words the dictionary did not have, looked up on every run of another generation
+    std::vector<MissingWord> missing_words_;
+    // Servers of this generation run query_ as is
+    uint64_t generation_ = 0;
 };
 
 void AddDocument(SearchServer& search_server, int document_id,
     std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+template <typename ExecutionPolicy>
+inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const PreparedQuery& query,
+    DocumentStatus status, const SearchOptions& options) const
+{
+    PooledQuery resolved;
+    return FindTopQueryDocuments(policy, ResolvePreparedQuery(query, *resolved), status, options);
+}
+
 template <typename DocumentPredicate>
 inline std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
     DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query, 1);
-
-    auto matched_documents = FindAllDocuments(query, document_predicate);
-
-    std::sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+    return FindTopDocuments(raw_query, document_predicate, SearchOptions{});
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+inline std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const {
+    PooledQuery query;
+    ParseQuery(raw_query, *query);
+    return FindTopQueryDocuments(std::execution::seq, *query, document_predicate, options);
 }
 
 template <typename DocumentPredicate, typename ExecutionPolicy>
 inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
     DocumentPredicate document_predicate) const 
 {
-    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
-        return FindTopDocuments(raw_query, document_predicate);
-    }
-
-    const auto query = ParseQuery(raw_query, 1);
-    auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
-
-    std::sort(std::execution::par, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            const auto EPSILON = 1e-6;
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
+    return FindTopDocuments(policy, raw_query, document_predicate, SearchOptions{});
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate, typename ExecutionPolicy>
+inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&&, std::string_view raw_query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const
+{
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        return FindTopDocuments(raw_query, document_predicate, options);
     }
 
-    return matched_documents;
+    PooledQuery query;
+    ParseQuery(raw_query, *query);
+    return FindTopQueryDocuments(std::execution::par, *query, document_predicate, options);
 }
 
 template <typename ExecutionPolicy>
 inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, 
     DocumentStatus status) const 
 {
-    return FindTopDocuments(policy, raw_query, 
-        [status](int document_id, DocumentStatus document_status, int rating) { 
-            return document_status == status; 
-        });
+    return FindTopDocuments(policy, raw_query, status, SearchOptions{});
+}
+
+template <typename ExecutionPolicy>
+inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    DocumentStatus status, const SearchOptions& options) const
+{
+    PooledQuery query;
+    ParseQuery(raw_query, *query);
+    return FindTopQueryDocuments(policy, *query, status, options);
 }
 
 template <typename ExecutionPolicy>
@@ -225,109 +595,378 @@ inline std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& po
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+template <typename DocumentPredicate, typename ExecutionPolicy>
+inline std::vector<Document> SearchServer::FindTopQueryDocuments(ExecutionPolicy&& policy, const Query& query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const
+{
+    METRIC_STAGE(QUERY_SEARCH);
+    METRIC_COUNT(QUERIES, 1);
+    const size_t result_count = GetResultCount(options);
+    CheckCancelled(options);
+    auto matched_documents = FindAllDocuments(policy, query, document_predicate, result_count, options);
+    {
+        METRIC_STAGE(QUERY_TOP_K);
+        SelectTopDocuments(matched_documents, result_count);
+    }
+
+    return matched_documents;
+}
+
+template <typename ExecutionPolicy>
+inline std::vector<Document> SearchServer::FindTopQueryDocuments(ExecutionPolicy&& policy, const Query& query,
+    DocumentStatus status, const SearchOptions& options) const
+{
+    const auto document_predicate = [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    };
+    if (!result_cache_) {
+        return FindTopQueryDocuments(policy, query, document_predicate, options);
+    }
+    const std::string key = MakeResultCacheKey(query, status, options);
+    if (auto cached = result_cache_->Find(key, generation_)) {
+        return std::move(*cached);
+    }
+    auto matched_documents = FindTopQueryDocuments(policy, query, document_predicate, options);
+    result_cache_->Insert(key, generation_, matched_documents);
+    return matched_documents;
+}
+
 template <typename DocumentPredicate>
-inline std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const 
+inline void SearchServer::FindDocumentsInRange(const QueryPostings& postings, DocumentPredicate& document_predicate,
+    DocOrdinal begin, DocOrdinal end, size_t posting_volume, const SearchOptions& options,
+    std::vector<Document>& matched_documents) const
 {
-    std::map<int, double> document_to_relevance;
+    PooledExclusionSet excluded;
+    FindExcludedInRange(postings, begin, end, *excluded);
 
-    for (const auto& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+    PooledScoreAccumulator document_to_relevance;
+    document_to_relevance->Reset(begin, end, posting_volume);
+
+    {
+        METRIC_STAGE(QUERY_SCORE);
+        for (const auto& [term, word_postings] : postings.plus) {
+            CheckCancelled(options);
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(term);
+            auto posting = word_postings->begin();
+            posting.SeekGEQ(begin);
+            for (; !posting.AtEnd() && posting.Document() < end; posting.Next()) {
+                if (excluded->Contains(posting.Document())) {
+                    continue;
+                }
+                const auto& document_data = documents_[posting.Document()];
+                if (document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                    document_to_relevance->Add(posting.Document(), posting.TermFreq() * inverse_document_freq);
+                }
             }
         }
     }
 
-    for (const auto& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    METRIC_STAGE(QUERY_MATERIALIZE);
+    const size_t matched_begin = matched_documents.size();
+    document_to_relevance->ForEach([this, &matched_documents](DocOrdinal ordinal, double relevance) {
+        matched_documents.push_back(
+            { documents_[ordinal].id, relevance, documents_[ordinal].rating });
+    });
+    METRIC_COUNT(MATCHED_DOCUMENTS, matched_documents.size() - matched_begin);
+}
+
+template <typename DocumentPredicate>
+inline void SearchServer::FindTopDocumentsInRange(const QueryPostings& postings, DocumentPredicate& document_predicate,
+    DocOrdinal begin, DocOrdinal end, size_t top_count, std::vector<double>& top_relevances,
+    const SearchOptions& options, std::vector<Document>& matched_documents) const
+{
+    // Documents whose relevance differs by less than EPSILON are ordered by rating,
+    // so only documents below the threshold by more than EPSILON can be skipped
+    const double EPSILON = 1e-6;
+    if (top_count == 0) {
+        return;
+    }
+    METRIC_STAGE(QUERY_SCORE);
+
+    // Ordinals are processed in windows: postings of the essential words are summed
+    // into a small array, then the candidates of the window are checked in order.
+    // A relevance is only read once its bit is set, so the array is not cleared
+    constexpr DocOrdinal WINDOW_SIZE = 4096;
+    constexpr size_t WINDOW_WORDS = WINDOW_SIZE / 64;
+    std::array<double, WINDOW_SIZE> window_relevance;
+    std::array<uint64_t, WINDOW_WORDS> window_touched{};
+
+    struct WordCursor {
+        PostingList::Cursor posting;
+        double inverse_document_freq;
+        double max_relevance;
+        // Postings expected in a window, the ones a non-essential word does not scan
+        double window_postings;
+    };
+    std::vector<WordCursor> words;
+    words.reserve(postings.plus.size());
+    const double windows_per_segment = static_cast<double>(std::max<DocOrdinal>(postings.end - postings.begin, 1))
+        / WINDOW_SIZE;
+    for (const auto& [term, word_postings] : postings.plus) {
+        const double inverse_document_freq = ComputeWordInverseDocumentFreq(term);
+        auto posting = word_postings->begin();
+        posting.SeekGEQ(begin);
+        words.push_back({ posting, inverse_document_freq, word_postings->MaxTermFreq() * inverse_document_freq,
+            word_postings->size() / windows_per_segment });
+    }
+    PooledExclusionSet excluded;
+    FindExcludedInRange(postings, begin, end, *excluded);
+
+    // Words by growing upper bound; max_relevance_below[i] bounds the relevance a document
+    // can get from words [0, i), a document with only these words is not worth scoring
+    std::sort(words.begin(), words.end(), [](const WordCursor& lhs, const WordCursor& rhs) {
+        return lhs.max_relevance < rhs.max_relevance;
+    });
+    std::vector<double> max_relevance_below(words.size() + 1, 0.0);
+    for (size_t i = 0; i < words.size(); ++i) {
+        max_relevance_below[i + 1] = max_relevance_below[i] + words[i].max_relevance;
+    }
+
+    // The top of the full heap is the threshold
+    double threshold = top_relevances.size() == top_count ? top_relevances.front()
+        : -std::numeric_limits<double>::infinity();
+    // Words before first_essential cannot lift a document over the threshold on their own
+    size_t first_essential = 0;
+    // Cleared once a window spent more seeks into the non-essential words than the postings
+    // they skipped, as with bounds of similar words all being candidates. The rest of the
+    // range is then scored exhaustively, only the threshold still drops documents
+    bool is_split_used = true;
+    const auto update_first_essential = [&] {
+        while (is_split_used && first_essential < words.size()
+            && max_relevance_below[first_essential + 1] < threshold - EPSILON) {
+            ++first_essential;
+        }
+    };
+    update_first_essential();
+
+    for (DocOrdinal window_begin = begin; window_begin < end && first_essential < words.size();) {
+        // Skip to the first ordinal any essential word has
+        DocOrdinal next_document = end;
+        for (size_t i = first_essential; i < words.size(); ++i) {
+            if (!words[i].posting.AtEnd()) {
+                next_document = std::min(next_document, words[i].posting.Document());
+            }
+        }
+        if (next_document >= end) {
+            break;
         }
-        for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+        CheckCancelled(options);
+        window_begin = std::max(window_begin, next_document);
+        const DocOrdinal window_end = static_cast<DocOrdinal>(
+            std::min<size_t>(end, static_cast<size_t>(window_begin) + WINDOW_SIZE));
+
+        // The split into essential words is fixed within the window
+        const size_t window_first_essential = first_essential;
+        size_t window_seeks = 0;
+        for (size_t i = window_first_essential; i < words.size(); ++i) {
+            auto& posting = words[i].posting;
+            const double inverse_document_freq = words[i].inverse_document_freq;
+            for (; !posting.AtEnd() && posting.Document() < window_end; posting.Next()) {
+                const DocOrdinal offset = posting.Document() - window_begin;
+                const uint64_t bit = uint64_t{ 1 } << (offset % 64);
+                if ((window_touched[offset / 64] & bit) == 0) {
+                    window_touched[offset / 64] |= bit;
+                    window_relevance[offset] = 0;
+                }
+                window_relevance[offset] += posting.TermFreq() * inverse_document_freq;
+            }
         }
+
+        for (size_t word_index = 0; word_index < WINDOW_WORDS; ++word_index) {
+            while (window_touched[word_index] != 0) {
+                const int bit = __builtin_ctzll(window_touched[word_index]);
+                window_touched[word_index] &= window_touched[word_index] - 1;
+                const DocOrdinal offset = static_cast<DocOrdinal>(word_index * 64 + bit);
+                const DocOrdinal document = window_begin + offset;
+                double relevance = window_relevance[offset];
+
+                if (relevance + max_relevance_below[window_first_essential] < threshold - EPSILON
+                    || excluded->Contains(document)) {
+                    continue;
+                }
+                const auto& document_data = documents_[document];
+                if (!document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                    continue;
+                }
+
+                bool skipped = false;
+                for (size_t i = window_first_essential; i-- > 0;) {
+                    if (relevance + max_relevance_below[i + 1] < threshold - EPSILON) {
+                        skipped = true;
+                        break;
+                    }
+                    auto& posting = words[i].posting;
+                    ++window_seeks;
+                    posting.SeekGEQ(document);
+                    if (!posting.AtEnd() && posting.Document() == document) {
+                        relevance += posting.TermFreq() * words[i].inverse_document_freq;
+                    }
+                }
+                if (skipped || relevance < threshold - EPSILON) {
+                    continue;
+                }
+
+                matched_documents.push_back({ document_data.id, relevance, document_data.rating });
+                if (top_relevances.size() == top_count && relevance <= top_relevances.front()) {
+                    continue;
+                }
+                top_relevances.push_back(relevance);
+                std::push_heap(top_relevances.begin(), top_relevances.end(), std::greater<double>());
+                if (top_relevances.size() > top_count) {
+                    std::pop_heap(top_relevances.begin(), top_relevances.end(), std::greater<double>());
+                    top_relevances.pop_back();
+                }
+                if (top_relevances.size() == top_count && top_relevances.front() > threshold) {
+                    threshold = top_relevances.front();
+                    update_first_essential();
+                }
+            }
+        }
+
+        double skipped_postings = 0;
+        for (size_t i = 0; i < window_first_essential; ++i) {
+            skipped_postings += words[i].window_postings;
+        }
+        if (window_seeks > skipped_postings * (window_end - window_begin) / WINDOW_SIZE) {
+            // Cursors of the words made essential again start at the next window
+            for (size_t i = 0; i < first_essential; ++i) {
+                words[i].posting.SeekGEQ(window_end);
+            }
+            first_essential = 0;
+            is_split_used = false;
+        }
+
+        // Candidates kept earlier may have fallen below the raised threshold
+        if (matched_documents.size() > 4 * top_count) {
+            matched_documents.erase(std::remove_if(matched_documents.begin(), matched_documents.end(),
+                [threshold, EPSILON](const Document& matched) {
+                    return matched.relevance < threshold - EPSILON;
+                }), matched_documents.end());
+        }
+        window_begin = window_end;
     }
+}
+
+template <typename DocumentPredicate>
+inline void SearchServer::FindCandidatesInRange(const QueryPostings& postings, DocumentPredicate& document_predicate,
+    DocOrdinal begin, DocOrdinal end, size_t top_count, std::vector<double>& top_relevances,
+    const SearchOptions& options, std::vector<Document>& matched_documents) const
+{
+    if (options.evaluation == QueryEvaluation::MAX_SCORE) {
+        FindTopDocumentsInRange(postings, document_predicate, begin, end, top_count, top_relevances, options,
+            matched_documents);
+    } else {
+        const size_t range_volume = static_cast<size_t>(
+            static_cast<double>(postings.plus_volume) * (end - begin) / (postings.end - postings.begin));
+        FindDocumentsInRange(postings, document_predicate, begin, end, range_volume, options, matched_documents);
+    }
+}
 
+template <typename DocumentPredicate>
+inline std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate,
+    size_t top_count, const SearchOptions& options) const
+{
     std::vector<Document> matched_documents;
-    for (const auto& [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+    std::vector<double> top_relevances;
+    for (const QueryPostings& postings : FindQueryPostings(query)) {
+        FindCandidatesInRange(postings, document_predicate, postings.begin, postings.end,
+            top_count, top_relevances, options, matched_documents);
     }
     return matched_documents;
 }
 
 template <typename DocumentPredicate, typename ExecutionPolicy>
-inline std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
-    DocumentPredicate document_predicate) const
+inline std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&&, const Query& query,
+    DocumentPredicate document_predicate, size_t top_count, const SearchOptions& options) const
 {
     if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
-        return FindAllDocuments(query, document_predicate);
+        return FindAllDocuments(query, document_predicate, top_count, options);
     }
 
-    ConcurrentMap<int, double> document_to_relevance(static_cast<size_t>(std::thread::hardware_concurrency()));
+    const auto segment_postings = FindQueryPostings(query);
+    size_t plus_volume = 0;
+    for (const QueryPostings& postings : segment_postings) {
+        plus_volume += postings.plus_volume;
+    }
 
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-        [this, &document_to_relevance, document_predicate](const auto& word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
-                }
-            }
-        });
+    // Every worker scores its own range of ordinals into its own accumulator,
+    // so no locks are needed and the results only have to be concatenated
+    const size_t task_count = std::min<size_t>(executor_->GetWorkerCount(), plus_volume / MIN_POSTINGS_PER_TASK);
+    if (task_count <= 1) {
+        std::vector<Document> matched_documents;
+        std::vector<double> top_relevances;
+        for (const QueryPostings& postings : segment_postings) {
+            FindCandidatesInRange(postings, document_predicate, postings.begin, postings.end,
+                top_count, top_relevances, options, matched_documents);
+        }
+        return matched_documents;
+    }
 
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_to_relevance](const auto& word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-                    document_to_relevance.erase(document_id);
-                }
-            }
+    // Segments get tasks in proportion to their postings of the query
+    struct Task {
+        const QueryPostings* postings;
+        DocOrdinal begin;
+        DocOrdinal end;
+    };
+    std::vector<Task> tasks;
+    for (const QueryPostings& postings : segment_postings) {
+        const size_t part_count = std::max<size_t>(1, (postings.plus_volume * task_count + plus_volume / 2) / plus_volume);
+        const size_t length = postings.end - postings.begin;
+        for (size_t part = 0; part < part_count; ++part) {
+            tasks.push_back({ &postings, static_cast<DocOrdinal>(postings.begin + length * part / part_count),
+                static_cast<DocOrdinal>(postings.begin + length * (part + 1) / part_count) });
+        }
+    }
+
+    std::vector<std::vector<Document>> task_documents(tasks.size());
+    executor_->ParallelFor(tasks.size(),
+        [&](size_t index) {
+            const Task& task = tasks[index];
+            auto& documents = task_documents[index];
+            auto task_predicate = document_predicate;
+            std::vector<double> top_relevances;
+            FindCandidatesInRange(*task.postings, task_predicate, task.begin, task.end, top_count, top_relevances,
+                options, documents);
+            SelectTopDocuments(documents, top_count);
         });
 
+    size_t matched_count = 0;
+    for (const auto& documents : task_documents) {
+        matched_count += documents.size();
+    }
     std::vector<Document> matched_documents;
-    for (const auto& container : document_to_relevance) {
-        std::for_each(container.map_part.begin(), container.map_part.end(),
-            [this, &matched_documents](const auto& id_to_relevance) {
-                matched_documents.push_back({ id_to_relevance.first, id_to_relevance.second, documents_.at(id_to_relevance.first).rating });
-            });
+    matched_documents.reserve(matched_count);
+    for (const auto& documents : task_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
     }
-
     return matched_documents;
 }
 
 template<class ExecutionPolicy>
-void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    // резервируем место для слов документа, полученных в transfom 
-    std::vector<std::string_view> word_in_erase_document(id_to_words_freqs_.at(document_id).size());
-
-    // вытаскивем указатели на строки из мапы, чтобы в параллельном алгоритме не возникало проблем
-    std::transform(policy, id_to_words_freqs_.at(document_id).begin(),
-        id_to_words_freqs_.at(document_id).end(), word_in_erase_document.begin(),
-        [](const auto& word_to_freqs) {
-            return word_to_freqs.first;
-        });
-
-    // удаляем id документов из мапы слов
-    std::for_each(policy, word_in_erase_document.begin(), word_in_erase_document.end(),
-        [document_id, this](const auto& word) {
-            word_to_document_freqs_[word].erase(document_id);
-        });
+void SearchServer::RemoveDocument(ExecutionPolicy&&, int document_id) {
+    const DocOrdinal ordinal = GetOrdinal(document_id);
+    METRIC_STAGE(REMOVE_DOCUMENT);
+    // удаление записывается в журнал до применения, при ошибке записи документ остается
+    LogRemoveDocument(document_id);
+    // прежние результаты запросов в кэше больше не подходят
+    generation_ = NextGeneration();
+
+    // слова документа в словаре
+    const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+
+    // документ только помечается удаленным в своем сегменте, списки документов слов не меняются,
+    // поэтому удаление не зависит от их длины и распараллеливать нечего
+    index_.Remove(ordinal, terms_begin, terms_end);
+    // IDF этих слов пересчитается при следующем запросе
+    for (const TermId* term = terms_begin; term != terms_end; ++term) {
+        idf_.MarkTermChanged(*term);
+    }
+    idf_.MarkDocumentCountChanged();
 
     // словарь id -> cловарь слов и ее частоты
     id_to_words_freqs_.erase(document_id);
 
-    // очистка словаря id -> rating и status документа
-    if (documents_.count(document_id)) {
-        documents_.erase(document_id);
-    }
-    // удаление id из вектора документов
-    document_ids_.erase(document_ids_.find(document_id));
-}
\ No newline at end of file
+    // место в documents_ остается за порядковым номером документа, он больше не используется
+    document_ordinals_.Erase(document_id);
+    METRIC_COUNT(REMOVED_DOCUMENTS, 1);
+}
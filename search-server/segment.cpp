@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "segment.h"
+#include "snapshot.h"
+
+using namespace std::string_literals;
+
+Segment::Segment(InvertedIndex&& index, DocOrdinal begin, DocOrdinal end, const uint64_t* deleted)
+    : format_(index.GetFormat())
+    , begin_(begin)
+    , end_(end) {
+    // Lists of the mutable index go in the order their terms first occurred
+    std::vector<uint32_t> order(index.terms_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&index](uint32_t lhs, uint32_t rhs) {
+        return index.terms_[lhs] < index.terms_[rhs];
+    });
+    for (const uint32_t list_index : order) {
+        const TermId term = index.terms_[list_index];
+        // Copies of the index may share the list, so it is copied rather than taken
+        PostingList list = index.GetList(list_index);
+        if (deleted != nullptr && list.size() > 0) {
+            PostingList live(format_);
+            live.AppendFrom(list, deleted, begin_);
+            list = std::move(live);
+        }
+        if (list.size() > 0) {
+            list.ShrinkToFit();
+            posting_count_ += list.size();
+            terms_.push_back(term);
+            lists_.push_back(std::move(list));
+        }
+    }
+    terms_.shrink_to_fit();
+    lists_.shrink_to_fit();
+    index = InvertedIndex(format_);
+}
+
+Segment::Segment(const std::vector<Source>& sources)
+    : format_(sources.front().segment->format_)
+    , begin_(sources.front().segment->begin_)
+    , end_(sources.back().segment->end_) {
+    // Term ids of every source are sorted, so the union is walked in order
+    std::vector<size_t> positions(sources.size(), 0);
+    while (true) {
+        TermId term = TermDictionary::NO_TERM;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            const auto& terms = sources[i].segment->terms_;
+            if (positions[i] < terms.size()) {
+                term = std::min(term, terms[positions[i]]);
+            }
+        }
+        if (term == TermDictionary::NO_TERM) {
+            break;
+        }
+        PostingList list(format_);
+        for (size_t i = 0; i < sources.size(); ++i) {
+            const Segment& source = *sources[i].segment;
+            if (positions[i] < source.terms_.size() && source.terms_[positions[i]] == term) {
+                list.AppendFrom(source.lists_[positions[i]], sources[i].deleted, source.begin_);
+                ++positions[i];
+            }
+        }
+        if (list.size() > 0) {
+            list.ShrinkToFit();
+            posting_count_ += list.size();
+            terms_.push_back(term);
+            lists_.push_back(std::move(list));
+        }
+    }
+    terms_.shrink_to_fit();
+    lists_.shrink_to_fit();
+}
+
+Segment::Segment(SnapshotReader& reader, PostingFormat format, size_t term_count)
+    : format_(format)
+    , begin_(reader.Read<DocOrdinal>())
+    , end_(reader.Read<DocOrdinal>())
+    , terms_(reader.ReadArray<TermId>()) {
+    if (begin_ > end_ || !std::is_sorted(terms_.begin(), terms_.end())
+        || (!terms_.empty() && terms_[terms_.size() - 1] >= term_count)
+        || std::adjacent_find(terms_.begin(), terms_.end()) != terms_.end()) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    lists_.assign(terms_.size(), PostingList(format_));
+    for (PostingList& list : lists_) {
+        list.Load(reader, begin_, end_);
+        posting_count_ += list.size();
+    }
+}
+
+size_t Segment::MemoryUsage() const {
+    size_t bytes = terms_.MemoryUsage() + lists_.capacity() * sizeof(PostingList);
+    for (const PostingList& list : lists_) {
+        bytes += list.MemoryUsage();
+    }
+    return bytes;
+}
+
+void Segment::Save(SnapshotWriter& writer) const {
+    writer.Write(begin_);
+    writer.Write(end_);
+    writer.WriteArray(terms_);
+    for (const PostingList& list : lists_) {
+        list.Save(writer);
+    }
+}
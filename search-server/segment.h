@@ -0,0 +1,66 @@
+// Обьявление неизменяемого сегмента индекса
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "inverted_index.h"
+#include "pod_buffer.h"
+#include "term_dictionary.h"
+
+// Posting lists of the documents with ordinals in [begin, end), never changed
+// once built, so index versions share it freely. Only the terms present in
+// the segment have lists, found by binary search over the sorted term ids.
+class Segment {
+public:
+    // Segment to merge and the bit set of its deleted documents,
+    // bit i stands for ordinal GetBegin() + i, nullptr if none were deleted
+    struct Source {
+        const Segment* segment;
+        const uint64_t* deleted;
+    };
+
+    // Copies the lists of the mutable index and clears it, copies of it keep their lists.
+    // Postings of the documents marked in deleted are dropped, see Source
+    Segment(InvertedIndex&& index, DocOrdinal begin, DocOrdinal end, const uint64_t* deleted);
+    // Merges consecutive segments, the postings of deleted documents are dropped
+    explicit Segment(const std::vector<Source>& sources);
+    // Postings stay in the mapped snapshot, term ids must be less than term_count
+    Segment(SnapshotReader& reader, PostingFormat format, size_t term_count);
+
+    PostingFormat GetFormat() const {
+        return format_;
+    }
+
+    DocOrdinal GetBegin() const {
+        return begin_;
+    }
+
+    DocOrdinal GetEnd() const {
+        return end_;
+    }
+
+    // Returns nullptr if no document of the segment has the term
+    const PostingList* Find(TermId term) const {
+        const auto it = std::lower_bound(terms_.begin(), terms_.end(), term);
+        return it == terms_.end() || *it != term ? nullptr : &lists_[it - terms_.begin()];
+    }
+
+    size_t PostingCount() const {
+        return posting_count_;
+    }
+
+    // Bytes taken by the posting lists and the term ids
+    size_t MemoryUsage() const;
+
+    void Save(SnapshotWriter& writer) const;
+
+private:
+    PostingFormat format_;
+    DocOrdinal begin_;
+    DocOrdinal end_;
+    size_t posting_count_ = 0;
+    PodBuffer<TermId> terms_;
+    std::vector<PostingList> lists_;
+};
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "segmented_index.h"
+#include "snapshot.h"
+
+using namespace std::string_literals;
+
+// Background thread merging segments. It reads only immutable segments and
+// its own copies of their deletion bit sets, so it never waits for the writer.
+class SegmentedIndex::Merger {
+public:
+    struct Result {
+        // Segments as they were submitted
+        std::vector<Entry> sources;
+        // nullptr if the merge failed, the sources stay as they are then
+        std::shared_ptr<const Segment> segment;
+    };
+
+    Merger()
+        : worker_([this] {
+            Run();
+        }) {
+    }
+
+    ~Merger() {
+        {
+            std::lock_guard guard(mutex_);
+            stop_ = true;
+        }
+        has_tasks_.notify_one();
+        worker_.join();
+    }
+
+    void Submit(std::vector<Entry> sources) {
+        {
+            std::lock_guard guard(mutex_);
+            tasks_.push_back(std::move(sources));
+        }
+        has_tasks_.notify_one();
+    }
+
+    bool HasResults() const {
+        return has_results_.load(std::memory_order_acquire);
+    }
+
+    std::vector<Result> TakeResults() {
+        std::lock_guard guard(mutex_);
+        has_results_.store(false, std::memory_order_relaxed);
+        return std::exchange(results_, {});
+    }
+
+    void WaitIdle() {
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [this] {
+            return tasks_.empty() && !is_merging_;
+        });
+    }
+
+private:
+    void Run() {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            has_tasks_.wait(lock, [this] {
+                return stop_ || !tasks_.empty();
+            });
+            if (stop_) {
+                return;
+            }
+            Result result{ std::move(tasks_.front()), nullptr };
+            tasks_.pop_front();
+            is_merging_ = true;
+            lock.unlock();
+
+            try {
+                std::vector<Segment::Source> merge_sources;
+                merge_sources.reserve(result.sources.size());
+                for (const Entry& source : result.sources) {
+                    merge_sources.push_back({ source.segment.get(),
+                        source.deleted_count > 0 ? source.deleted.data() : nullptr });
+                }
+                result.segment = std::make_shared<const Segment>(merge_sources);
+            } catch (...) {
+                // Out of memory, the writer keeps the sources unmerged
+            }
+
+            lock.lock();
+            results_.push_back(std::move(result));
+            has_results_.store(true, std::memory_order_release);
+            is_merging_ = false;
+            idle_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    std::condition_variable idle_;
+    std::deque<std::vector<Entry>> tasks_;
+    std::vector<Result> results_;
+    std::atomic<bool> has_results_ = false;
+    bool is_merging_ = false;
+    bool stop_ = false;
+    // Declared last, so it starts when everything it uses is constructed
+    std::thread worker_;
+};
+
+SegmentedIndex::SegmentedIndex(const IndexOptions& options)
+    : options_(options)
+    , mutable_(options.posting_format) {
+}
+
+SegmentedIndex::SegmentedIndex(const SegmentedIndex& other)
+    : options_(other.options_)
+    , segments_(other.segments_)
+    , mutable_(other.mutable_)
+    , mutable_begin_(other.mutable_begin_)
+    , mutable_end_(other.mutable_end_)
+    , mutable_deleted_(other.mutable_deleted_)
+    , mutable_deleted_count_(other.mutable_deleted_count_)
+    , document_freqs_(other.document_freqs_) {
+    for (Entry& entry : segments_) {
+        entry.is_merging = false;
+    }
+}
+
+SegmentedIndex::~SegmentedIndex() = default;
+
+void SegmentedIndex::Add(TermId term, DocOrdinal document, uint32_t count, uint32_t document_length) {
+    if (term >= document_freqs_.size()) {
+        document_freqs_.Grow(term + 1, 0);
+    }
+    ++document_freqs_.Mutable(term);
+    mutable_.Add(term, document, count, document_length);
+}
+
+void SegmentedIndex::FinishDocuments(DocOrdinal end) {
+    mutable_end_ = end;
+    while (mutable_deleted_.size() * 64 < static_cast<size_t>(mutable_end_ - mutable_begin_)) {
+        mutable_deleted_.push_back(0);
+    }
+    if (mutable_.PostingCount() >= options_.segment_posting_count) {
+        Flush();
+    }
+    InstallMerges();
+}
+
+void SegmentedIndex::Remove(DocOrdinal document, const TermId* terms_begin, const TermId* terms_end) {
+    for (const TermId* term = terms_begin; term != terms_end; ++term) {
+        --document_freqs_.Mutable(*term);
+    }
+    if (document >= mutable_begin_) {
+        MarkDeleted(mutable_deleted_, document - mutable_begin_);
+        ++mutable_deleted_count_;
+    } else {
+        const auto entry = segments_.begin() + FindEntry(document);
+        MarkDeleted(entry->deleted, document - entry->segment->GetBegin());
+        ++entry->deleted_count;
+        if (NeedsVacuum(*entry)) {
+            SubmitMerge(entry, entry + 1);
+        }
+    }
+    InstallMerges();
+}
+
+size_t SegmentedIndex::GetSegmentCount() const {
+    return segments_.size() + (mutable_end_ > mutable_begin_ ? 1 : 0);
+}
+
+SegmentedIndex::SegmentView SegmentedIndex::GetSegment(size_t segment) const {
+    if (segment < segments_.size()) {
+        const Entry& entry = segments_[segment];
+        return { entry.segment->GetBegin(), entry.segment->GetEnd(),
+            entry.deleted_count > 0 ? entry.deleted.data() : nullptr, entry.segment.get(), nullptr };
+    }
+    return { mutable_begin_, mutable_end_, mutable_deleted_count_ > 0 ? mutable_deleted_.data() : nullptr,
+        nullptr, &mutable_ };
+}
+
+bool SegmentedIndex::Contains(TermId term, DocOrdinal document) const {
+    const PostingList* postings = document >= mutable_begin_ ? mutable_.Find(term)
+        : segments_[FindEntry(document)].segment->Find(term);
+    return postings != nullptr && postings->Contains(document);
+}
+
+void SegmentedIndex::WaitForMerges() {
+    while (merger_) {
+        merger_->WaitIdle();
+        InstallMerges();
+        if (std::none_of(segments_.begin(), segments_.end(), [](const Entry& entry) {
+                return entry.is_merging;
+            })) {
+            break;
+        }
+    }
+}
+
+size_t SegmentedIndex::MemoryUsage() const {
+    size_t bytes = mutable_.MemoryUsage() + mutable_deleted_.MemoryUsage() + document_freqs_.MemoryUsage();
+    for (const Entry& entry : segments_) {
+        bytes += entry.segment->MemoryUsage() + entry.deleted.MemoryUsage();
+    }
+    return bytes;
+}
+
+void SegmentedIndex::Save(SnapshotWriter& writer) const {
+    writer.Write(static_cast<uint64_t>(GetSegmentCount()));
+    for (const Entry& entry : segments_) {
+        entry.segment->Save(writer);
+        writer.WriteArray(entry.deleted);
+        writer.Write(static_cast<uint64_t>(entry.deleted_count));
+        writer.Write(static_cast<uint64_t>(entry.document_count));
+    }
+    if (mutable_end_ > mutable_begin_) {
+        // The copy shares the postings, only the segment made of it packs them
+        Segment(InvertedIndex(mutable_), mutable_begin_, mutable_end_, nullptr).Save(writer);
+        writer.WriteArray(mutable_deleted_);
+        writer.Write(static_cast<uint64_t>(mutable_deleted_count_));
+        writer.Write(static_cast<uint64_t>(mutable_end_ - mutable_begin_));
+    }
+    writer.WriteArray(document_freqs_);
+}
+
+void SegmentedIndex::Load(SnapshotReader& reader, size_t term_count) {
+    const auto segment_count = reader.Read<uint64_t>();
+    DocOrdinal end = 0;
+    for (uint64_t i = 0; i < segment_count; ++i) {
+        Entry entry;
+        entry.segment = std::make_shared<const Segment>(reader, options_.posting_format, term_count);
+        entry.deleted = reader.ReadArray<uint64_t>();
+        entry.deleted_count = reader.Read<uint64_t>();
+        entry.document_count = reader.Read<uint64_t>();
+        const size_t length = entry.segment->GetEnd() - entry.segment->GetBegin();
+        if (entry.segment->GetBegin() != end || entry.deleted.size() != (length + 63) / 64
+            || entry.deleted_count > entry.document_count || entry.document_count > length) {
+            throw std::runtime_error("Snapshot is corrupted"s);
+        }
+        end = entry.segment->GetEnd();
+        segments_.push_back(std::move(entry));
+    }
+    mutable_begin_ = mutable_end_ = end;
+    const auto document_freqs = reader.ReadArray<uint32_t>();
+    // Frequencies grow with the terms added to this index, the dictionary may hold more
+    if (document_freqs.size() > term_count) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    document_freqs_ = PagedBuffer<uint32_t>::Borrow(document_freqs.data(), document_freqs.size());
+}
+
+PodBuffer<uint64_t> SegmentedIndex::MakeBitSet(size_t length) {
+    PodBuffer<uint64_t> bits;
+    bits.resize((length + 63) / 64);
+    std::fill(bits.MutableData(), bits.MutableData() + bits.size(), 0);
+    return bits;
+}
+
+void SegmentedIndex::MarkDeleted(PodBuffer<uint64_t>& bits, size_t offset) {
+    bits.MutableData()[offset / 64] |= uint64_t{ 1 } << (offset % 64);
+}
+
+size_t SegmentedIndex::FindEntry(DocOrdinal document) const {
+    return std::upper_bound(segments_.begin(), segments_.end(), document,
+        [](DocOrdinal value, const Entry& entry) {
+            return value < entry.segment->GetEnd();
+        }) - segments_.begin();
+}
+
+void SegmentedIndex::Flush() {
+    // Deleted documents are dropped right away, so the segment starts with no deletions
+    Entry entry;
+    entry.segment = std::make_shared<const Segment>(std::move(mutable_), mutable_begin_, mutable_end_,
+        mutable_deleted_count_ > 0 ? mutable_deleted_.data() : nullptr);
+    entry.deleted = MakeBitSet(mutable_end_ - mutable_begin_);
+    entry.document_count = mutable_end_ - mutable_begin_ - mutable_deleted_count_;
+    segments_.push_back(std::move(entry));
+
+    mutable_ = InvertedIndex(options_.posting_format);
+    mutable_begin_ = mutable_end_;
+    mutable_deleted_ = {};
+    mutable_deleted_count_ = 0;
+    ScheduleMerges();
+}
+
+void SegmentedIndex::InstallMerges() {
+    if (!merger_ || !merger_->HasResults()) {
+        return;
+    }
+    for (auto& result : merger_->TakeResults()) {
+        // Sources are still in place: only merges replace segments, and they were marked
+        const auto first = segments_.begin() + FindEntry(result.sources.front().segment->GetBegin());
+        const auto last = first + result.sources.size();
+        if (!result.segment) {
+            std::for_each(first, last, [](Entry& entry) {
+                entry.is_merging = false;
+            });
+            continue;
+        }
+
+        // Documents deleted before the merge have no postings in the merged segment,
+        // the ones deleted during it are carried over
+        Entry merged;
+        merged.segment = std::move(result.segment);
+        const DocOrdinal begin = merged.segment->GetBegin();
+        merged.deleted = MakeBitSet(merged.segment->GetEnd() - begin);
+        uint64_t* bits = merged.deleted.MutableData();
+        for (size_t i = 0; i < result.sources.size(); ++i) {
+            const Entry& entry = first[i];
+            const Entry& source = result.sources[i];
+            merged.document_count += source.document_count - source.deleted_count;
+            if (entry.deleted_count == source.deleted_count) {
+                continue;
+            }
+            const size_t shift = entry.segment->GetBegin() - begin;
+            for (size_t word = 0; word < entry.deleted.size(); ++word) {
+                for (uint64_t set = entry.deleted[word] & ~source.deleted[word]; set != 0; set &= set - 1) {
+                    const size_t offset = shift + word * 64 + __builtin_ctzll(set);
+                    bits[offset / 64] |= uint64_t{ 1 } << (offset % 64);
+                    ++merged.deleted_count;
+                }
+            }
+        }
+        *first = std::move(merged);
+        segments_.erase(first + 1, last);
+    }
+    ScheduleMerges();
+}
+
+void SegmentedIndex::ScheduleMerges() {
+    const size_t merge_factor = std::max<size_t>(2, options_.merge_factor);
+    size_t run_length = 0;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (segments_[i].is_merging) {
+            run_length = 0;
+            continue;
+        }
+        if (run_length > 0 && GetTier(segments_[i]) != GetTier(segments_[i - 1])) {
+            run_length = 0;
+        }
+        if (++run_length == merge_factor) {
+            SubmitMerge(segments_.begin() + (i + 1 - merge_factor), segments_.begin() + (i + 1));
+            run_length = 0;
+        }
+    }
+
+    // Merges above drop deletions too, the remaining segments are vacuumed on their own
+    for (auto it = segments_.begin(); it != segments_.end(); ++it) {
+        if (NeedsVacuum(*it)) {
+            SubmitMerge(it, it + 1);
+        }
+    }
+}
+
+void SegmentedIndex::SubmitMerge(std::vector<Entry>::iterator begin, std::vector<Entry>::iterator end) {
+    for (auto it = begin; it != end; ++it) {
+        it->is_merging = true;
+    }
+    if (!merger_) {
+        merger_ = std::make_unique<Merger>();
+    }
+    merger_->Submit(std::vector<Entry>(begin, end));
+}
+
+bool SegmentedIndex::NeedsVacuum(const Entry& entry) const {
+    return !entry.is_merging && entry.deleted_count > 0
+        && entry.deleted_count >= entry.document_count * options_.vacuum_deleted_share;
+}
+
+size_t SegmentedIndex::GetTier(const Entry& entry) const {
+    const size_t merge_factor = std::max<size_t>(2, options_.merge_factor);
+    size_t tier = 0;
+    for (size_t bound = std::max<size_t>(1, options_.segment_posting_count) * merge_factor;
+        entry.segment->PostingCount() >= bound; bound *= merge_factor) {
+        ++tier;
+    }
+    return tier;
+}
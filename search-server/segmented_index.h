@@ -0,0 +1,153 @@
+// Обьявление индекса из сегментов, которые сливаются в фоновом потоке
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "inverted_index.h"
+#include "pod_buffer.h"
+#include "segment.h"
+#include "term_dictionary.h"
+
+// Параметры индекса
+struct IndexOptions {
+    IndexOptions() = default;
+    // Вместо параметров можно передать только способ хранения списков документов
+    IndexOptions(PostingFormat posting_format)
+        : posting_format(posting_format) {
+    }
+
+    PostingFormat posting_format = PostingFormat::FLAT;
+    // Сколько вхождений слов накапливает изменяемый сегмент, прежде чем стать неизменяемым
+    size_t segment_posting_count = size_t{ 1 } << 18;
+    // Сколько соседних сегментов одного размера сливаются в один
+    size_t merge_factor = 4;
+    // При какой доле удаленных документов сегмент переписывается без них
+    double vacuum_deleted_share = 0.5;
+};
+
+// Index split by ordinal into consecutive segments, LSM style. New postings
+// go to a small mutable InvertedIndex, which becomes an immutable Segment once
+// it holds segment_posting_count postings. Copies of the index share the
+// immutable segments and the pages of the per-term document counts, so a
+// copy costs about the number of terms of the mutable segment.
+//
+// Removing a document only sets its bit in the deletion bit set of its
+// segment, and per-term counts of live documents keep the IDF exact.
+// A background thread merges runs of merge_factor neighbouring segments of
+// one size tier and drops the postings of deleted documents; the writer swaps
+// the result in at its next change. So the number of segments grows only
+// logarithmically with the index. A segment in which vacuum_deleted_share of
+// the documents are deleted is rewritten alone (vacuumed), and the mutable
+// segment drops its deleted postings when it is flushed, so terms left
+// without documents lose their lists as well.
+class SegmentedIndex {
+public:
+    explicit SegmentedIndex(const IndexOptions& options = {});
+    // The copy shares segments with the original, but not its merges in progress
+    SegmentedIndex(const SegmentedIndex& other);
+    SegmentedIndex& operator=(const SegmentedIndex&) = delete;
+    ~SegmentedIndex();
+
+    // Postings of a document must be added before FinishDocuments covers it
+    void Add(TermId term, DocOrdinal document, uint32_t count, uint32_t document_length);
+    // All documents before end are added. Flushes the mutable segment when it is full
+    void FinishDocuments(DocOrdinal end);
+    // Marks the document deleted, terms are the ones it was added with
+    void Remove(DocOrdinal document, const TermId* terms_begin, const TermId* terms_end);
+
+    // Count of documents with the term that are not removed
+    size_t DocumentFreq(TermId term) const {
+        return term < document_freqs_.size() ? document_freqs_[term] : 0;
+    }
+
+    // Postings of the documents in [begin, end)
+    struct SegmentView {
+        DocOrdinal begin;
+        DocOrdinal end;
+        // Bit i is set if document begin + i was removed, nullptr if none was
+        const uint64_t* deleted;
+        // Exactly one of them is set, index for the mutable segment
+        const Segment* segment;
+        const InvertedIndex* index;
+
+        const PostingList* Find(TermId term) const {
+            return segment != nullptr ? segment->Find(term) : index->Find(term);
+        }
+    };
+
+    // Segments go in ordinal order, the mutable one is the last
+    size_t GetSegmentCount() const;
+    SegmentView GetSegment(size_t segment) const;
+
+    // Ordinal after the last finished document
+    DocOrdinal GetEnd() const {
+        return mutable_end_;
+    }
+
+    // Whether the document was added with the term
+    bool Contains(TermId term, DocOrdinal document) const;
+
+    // Waits for the background merges and applies them until no run of segments qualifies
+    void WaitForMerges();
+
+    PostingFormat GetFormat() const {
+        return options_.posting_format;
+    }
+
+    const IndexOptions& GetOptions() const {
+        return options_;
+    }
+
+    // Bytes taken by the segments and the deletion bit sets
+    size_t MemoryUsage() const;
+
+    void Save(SnapshotWriter& writer) const;
+    // Loads into an empty index, the segments stay in the mapped snapshot.
+    // Term ids must be less than term_count, the size of the loaded dictionary
+    void Load(SnapshotReader& reader, size_t term_count);
+
+private:
+    struct Entry {
+        std::shared_ptr<const Segment> segment;
+        // Covers the whole segment, bit i stands for ordinal segment->GetBegin() + i
+        PodBuffer<uint64_t> deleted;
+        size_t deleted_count = 0;
+        // Documents whose postings are in the segment, deleted ones included
+        size_t document_count = 0;
+        bool is_merging = false;
+    };
+
+    class Merger;
+
+    // Bit set with no bits set for length ordinals
+    static PodBuffer<uint64_t> MakeBitSet(size_t length);
+    static void MarkDeleted(PodBuffer<uint64_t>& bits, size_t offset);
+
+    // Immutable segment containing the ordinal
+    size_t FindEntry(DocOrdinal document) const;
+
+    // Turns the mutable segment into an immutable one
+    void Flush();
+    // Swaps in finished merges, cheap when there are none
+    void InstallMerges();
+    // Hands runs of merge_factor segments of one tier and segments to vacuum to the merger
+    void ScheduleMerges();
+    void SubmitMerge(std::vector<Entry>::iterator begin, std::vector<Entry>::iterator end);
+    // Whether enough documents of the segment are deleted to rewrite it without them
+    bool NeedsVacuum(const Entry& entry) const;
+    // Segments of tier t hold less than segment_posting_count * merge_factor^(t + 1) postings
+    size_t GetTier(const Entry& entry) const;
+
+    IndexOptions options_;
+    std::vector<Entry> segments_;
+    InvertedIndex mutable_;
+    DocOrdinal mutable_begin_ = 0;
+    DocOrdinal mutable_end_ = 0;
+    PodBuffer<uint64_t> mutable_deleted_;
+    size_t mutable_deleted_count_ = 0;
+    PagedBuffer<uint32_t> document_freqs_;
+    // Started by the first merge
+    std::unique_ptr<Merger> merger_;
+};
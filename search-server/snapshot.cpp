@@ -0,0 +1,110 @@
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+using namespace std::string_literals;
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open snapshot "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read snapshot "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map snapshot "s + path);
+    }
+    data_ = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+void SyncFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open "s + path);
+    }
+    const bool is_synced = fsync(fd) == 0;
+    close(fd);
+    if (!is_synced) {
+        throw std::runtime_error("Cannot sync "s + path);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(std::ostream& out)
+    : out_(out) {
+    out_.write(snapshot::MAGIC, sizeof(snapshot::MAGIC));
+    Write(snapshot::VERSION);
+    Write(snapshot::BYTE_ORDER_MARK);
+}
+
+void SnapshotWriter::Pad(size_t size) {
+    static const char zeros[snapshot::ALIGNMENT] = {};
+    if (const size_t remainder = size % snapshot::ALIGNMENT; remainder != 0) {
+        out_.write(zeros, snapshot::ALIGNMENT - remainder);
+    }
+}
+
+SnapshotReader::SnapshotReader(std::shared_ptr<const MappedFile> file)
+    : file_(std::move(file)) {
+    if (file_->size() < sizeof(snapshot::MAGIC)
+        || std::memcmp(file_->data(), snapshot::MAGIC, sizeof(snapshot::MAGIC)) != 0) {
+        throw std::runtime_error("File is not a search server snapshot"s);
+    }
+    position_ = sizeof(snapshot::MAGIC);
+    if (Read<uint32_t>() != snapshot::VERSION) {
+        throw std::runtime_error("Unsupported snapshot version"s);
+    }
+    if (Read<uint32_t>() != snapshot::BYTE_ORDER_MARK) {
+        throw std::runtime_error("Snapshot was written with another byte order"s);
+    }
+}
+
+std::vector<std::string_view> SnapshotReader::ReadStrings() {
+    const auto ends = ReadArray<uint64_t>();
+    const auto total_size = Read<uint64_t>();
+    if ((!ends.empty() && ends.back() != total_size) || total_size > file_->size() - position_) {
+        throw std::runtime_error("Snapshot is truncated"s);
+    }
+    const char* chars = Take(total_size);
+    std::vector<std::string_view> strings;
+    strings.reserve(ends.size());
+    uint64_t begin = 0;
+    for (const uint64_t end : ends) {
+        if (end < begin || end > total_size) {
+            throw std::runtime_error("Snapshot is corrupted"s);
+        }
+        strings.emplace_back(chars + begin, end - begin);
+        begin = end;
+    }
+    return strings;
+}
+
+const char* SnapshotReader::Take(size_t size) {
+    const size_t padded_size = (size + snapshot::ALIGNMENT - 1) / snapshot::ALIGNMENT * snapshot::ALIGNMENT;
+    if (padded_size > file_->size() - position_) {
+        throw std::runtime_error("Snapshot is truncated"s);
+    }
+    const char* data = file_->data() + position_;
+    position_ += padded_size;
+    return data;
+}
@@ -0,0 +1,155 @@
+// Обьявление чтения и записи двоичного снимка поисковой системы
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "pod_buffer.h"
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Flushes the file or directory to disk, throws std::runtime_error on failure
+void SyncFile(const std::string& path);
+
+// Snapshot layout: a header with the magic and the format version, then
+// values and arrays in the order they were written. Every value and every
+// array starts at an 8-byte boundary, arrays are prefixed by their length,
+// so a reader can hand out pointers into the mapping without copying.
+// Byte order is the native one, the header rejects files of the other one.
+namespace snapshot {
+inline constexpr char MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+inline constexpr uint32_t VERSION = 5;
+inline constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+inline constexpr size_t ALIGNMENT = 8;
+} // namespace snapshot
+
+class SnapshotWriter {
+public:
+    // Writes the header
+    explicit SnapshotWriter(std::ostream& out);
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const T* data, size_t size) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Write(static_cast<uint64_t>(size));
+        WriteBytes(data, size * sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const PodBuffer<T>& buffer) {
+        WriteArray(buffer.data(), buffer.size());
+    }
+
+    template <typename T>
+    void WriteArray(const std::vector<T>& values) {
+        WriteArray(values.data(), values.size());
+    }
+
+    // Written as one array, ReadArray reads it back
+    template <typename T>
+    void WriteArray(const PagedBuffer<T>& buffer) {
+        Write(static_cast<uint64_t>(buffer.size()));
+        for (const PodBuffer<T>& page : buffer.GetPages()) {
+            out_.write(reinterpret_cast<const char*>(page.data()), page.size() * sizeof(T));
+        }
+        Pad(buffer.size() * sizeof(T));
+    }
+
+    // Writes the end offsets of the strings, then their concatenated characters
+    template <typename StringContainer>
+    void WriteStrings(const StringContainer& strings) {
+        std::vector<uint64_t> ends;
+        ends.reserve(strings.size());
+        uint64_t end = 0;
+        for (const auto& str : strings) {
+            end += str.size();
+            ends.push_back(end);
+        }
+        WriteArray(ends);
+        Write(end);
+        for (const auto& str : strings) {
+            out_.write(str.data(), str.size());
+        }
+        Pad(end);
+    }
+
+private:
+    void WriteBytes(const void* data, size_t size) {
+        out_.write(static_cast<const char*>(data), size);
+        Pad(size);
+    }
+
+    void Pad(size_t size);
+
+    std::ostream& out_;
+};
+
+class SnapshotReader {
+public:
+    // Checks the header, throws std::runtime_error if the file is not a snapshot of this version
+    explicit SnapshotReader(std::shared_ptr<const MappedFile> file);
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // Array borrowing the mapped memory, valid while the file is mapped
+    template <typename T>
+    PodBuffer<T> ReadArray() {
+        const auto size = Read<uint64_t>();
+        if (size > (file_->size() - position_) / sizeof(T)) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        return PodBuffer<T>::Borrow(reinterpret_cast<const T*>(Take(size * sizeof(T))), size);
+    }
+
+    // Views of the strings in the mapped memory
+    std::vector<std::string_view> ReadStrings();
+
+    const std::shared_ptr<const MappedFile>& GetFile() const {
+        return file_;
+    }
+
+private:
+    // Returns the next size bytes and moves past them and their padding
+    const char* Take(size_t size);
+
+    std::shared_ptr<const MappedFile> file_;
+    size_t position_ = 0;
+};
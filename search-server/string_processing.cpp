@@ -1,17 +1,190 @@
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
+#include <string>
 #include <string_view>
 
-std::vector<std::string_view> SplitIntoWords(std::string_view str) {
-    std::vector<std::string_view> result;
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_SERVER_X86 1
+#endif
+
+#include "string_processing.h"
+
+using namespace std::string_literals;
+
+namespace {
+
+// Word being read when a block ends, carried over to the next one
+struct TokenizerState {
+    bool in_word = false;
+    size_t word_start = 0;
+};
+
+// Scans text[begin, end) one character at a time, returns true if it has control characters
+bool ScanScalar(std::string_view text, size_t begin, size_t end, TokenizerState& state,
+    std::vector<std::string_view>& words) {
+    bool has_control = false;
+    for (size_t i = begin; i < end; ++i) {
+        const char c = text[i];
+        has_control |= c >= '\0' && c < ' ';
+        if (c == ' ') {
+            if (state.in_word) {
+                words.emplace_back(text.data() + state.word_start, i - state.word_start);
+                state.in_word = false;
+            }
+        } else if (!state.in_word) {
+            state.word_start = i;
+            state.in_word = true;
+        }
+    }
+    return has_control;
+}
+
+// Adds the words ending in a block of up to 64 characters at offset. Bit i of spaces is set
+// if character offset + i is a space; a word starts or ends wherever the bit differs from the previous one
+inline void AddBlockWords(std::string_view text, size_t offset, uint64_t spaces, TokenizerState& state,
+    std::vector<std::string_view>& words) {
+    uint64_t bounds = spaces ^ ((spaces << 1) | (state.in_word ? 0 : 1));
+    for (; bounds != 0; bounds &= bounds - 1) {
+        const size_t position = offset + __builtin_ctzll(bounds);
+        if (state.in_word) {
+            words.emplace_back(text.data() + state.word_start, position - state.word_start);
+        } else {
+            state.word_start = position;
+        }
+        state.in_word = !state.in_word;
+    }
+}
+
+bool FinishWords(std::string_view text, bool has_control, TokenizerState& state,
+    std::vector<std::string_view>& words) {
+    if (state.in_word) {
+        words.emplace_back(text.data() + state.word_start, text.size() - state.word_start);
+    }
+    return !has_control;
+}
+
+bool SplitScalar(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    TokenizerState state;
+    const bool has_control = ScanScalar(text, 0, text.size(), state, words);
+    return FinishWords(text, has_control, state, words);
+}
+
+#ifdef SEARCH_SERVER_X86
+
+// Control characters are 0-31, bytes from 128 are negative as signed and belong to words
+__attribute__((target("sse2")))
+bool SplitSse2(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    TokenizerState state;
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    __m128i control = _mm_setzero_si128();
+    constexpr size_t BLOCK_SIZE = 64;
+    size_t offset = 0;
+    for (; offset + BLOCK_SIZE <= text.size(); offset += BLOCK_SIZE) {
+        uint64_t spaces = 0;
+        for (size_t part = 0; part < BLOCK_SIZE / 16; ++part) {
+            const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + offset + part * 16));
+            spaces |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, space))))
+                << (part * 16);
+            control = _mm_or_si128(control, _mm_and_si128(_mm_cmpgt_epi8(chars, minus_one), _mm_cmplt_epi8(chars, space)));
+        }
+        AddBlockWords(text, offset, spaces, state, words);
+    }
+    bool has_control = _mm_movemask_epi8(control) != 0;
+    has_control |= ScanScalar(text, offset, text.size(), state, words);
+    return FinishWords(text, has_control, state, words);
+}
+
+__attribute__((target("avx2")))
+bool SplitAvx2(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    TokenizerState state;
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i minus_one = _mm256_set1_epi8(-1);
+    __m256i control = _mm256_setzero_si256();
+    constexpr size_t BLOCK_SIZE = 64;
+    size_t offset = 0;
+    for (; offset + BLOCK_SIZE <= text.size(); offset += BLOCK_SIZE) {
+        const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + offset));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + offset + 32));
+        const uint64_t spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, space)))
+            | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, space)))) << 32;
+        // a < b as b > a, AVX2 has no signed less-than
+        control = _mm256_or_si256(control, _mm256_and_si256(_mm256_cmpgt_epi8(low, minus_one), _mm256_cmpgt_epi8(space, low)));
+        control = _mm256_or_si256(control, _mm256_and_si256(_mm256_cmpgt_epi8(high, minus_one), _mm256_cmpgt_epi8(space, high)));
+        AddBlockWords(text, offset, spaces, state, words);
+    }
+    bool has_control = !_mm256_testz_si256(control, control);
+    has_control |= ScanScalar(text, offset, text.size(), state, words);
+    return FinishWords(text, has_control, state, words);
+}
+
+#endif
 
-    size_t space = str.find_first_not_of(' ');
-    size_t after_space = str.find_first_of(' ', space);
+using SplitFunction = bool (*)(std::string_view, std::vector<std::string_view>&);
 
-    while (space != str.npos) {
-        result.push_back(str.substr(space, after_space - space));
-        str.remove_prefix(std::min(str.size(), after_space));
-        space = str.find_first_not_of(' ');
-        after_space = str.find_first_of(' ', space);
+SplitFunction GetSplitFunction(Tokenizer tokenizer) {
+    switch (tokenizer) {
+#ifdef SEARCH_SERVER_X86
+    case Tokenizer::SSE2:
+        return SplitSse2;
+    case Tokenizer::AVX2:
+        return SplitAvx2;
+#endif
+    case Tokenizer::SCALAR:
+        return SplitScalar;
+    default:
+        throw std::invalid_argument("Tokenizer is not supported"s);
     }
+}
+
+// Chosen once, the processor does not change while the program runs
+SplitFunction ChooseSplitFunction() {
+    for (const Tokenizer tokenizer : { Tokenizer::AVX2, Tokenizer::SSE2 }) {
+        if (IsTokenizerSupported(tokenizer)) {
+            return GetSplitFunction(tokenizer);
+        }
+    }
+    return SplitScalar;
+}
+
+} // namespace
+
+bool IsTokenizerSupported(Tokenizer tokenizer) {
+    switch (tokenizer) {
+    case Tokenizer::SCALAR:
+        return true;
+#ifdef SEARCH_SERVER_X86
+    case Tokenizer::SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case Tokenizer::AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+bool SplitIntoWords(Tokenizer tokenizer, std::string_view text, std::vector<std::string_view>& words) {
+    if (!IsTokenizerSupported(tokenizer)) {
+        throw std::invalid_argument("Tokenizer is not supported"s);
+    }
+    return GetSplitFunction(tokenizer)(text, words);
+}
+
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+    static const SplitFunction split = ChooseSplitFunction();
+    return split(text, words);
+}
+
+std::vector<std::string_view> SplitIntoWords(std::string_view str) {
+    std::vector<std::string_view> result;
+    SplitIntoWords(str, result);
     return result;
-}
\ No newline at end of file
+}
@@ -1,10 +1,28 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <set>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// Разбивает text на слова, разделенные пробелами, и записывает их в words вместо прежнего
+// содержимого, так что буфер можно использовать повторно без выделения памяти.
+// Возвращает false, если в тексте есть управляющие символы (коды 0-31); слова записываются и тогда
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
+// Реализации разбора на слова. SplitIntoWords выбирает лучшую из поддерживаемых процессором
+enum class Tokenizer {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+bool IsTokenizerSupported(Tokenizer tokenizer);
+
+// Разбор заданной реализацией, она должна поддерживаться процессором
+bool SplitIntoWords(Tokenizer tokenizer, std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -14,4 +32,4 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
         }
     }
     return non_empty_strings;
-}
\ No newline at end of file
+}
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+#include "term_dictionary.h"
+#include "snapshot.h"
+
+TermDictionary::Table::Table(size_t capacity)
+    : slots(new std::atomic<TermId>[capacity])
+    , mask(capacity - 1) {
+    for (size_t slot = 0; slot < capacity; ++slot) {
+        slots[slot].store(NO_TERM, std::memory_order_relaxed);
+    }
+}
+
+size_t TermDictionary::GetTableCapacity(size_t term_count) {
+    size_t capacity = MIN_TABLE_CAPACITY;
+    while (capacity < term_count * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+TermId TermDictionary::Intern(std::string_view term) {
+    if (const TermId id = Find(term); id != NO_TERM) {
+        return id;
+    }
+    Shared& shared = AcquireTail();
+    const TermId id = static_cast<TermId>(id_to_term_.size());
+    id_to_term_.push_back(Store(term));
+    const Table* table = shared.table.load(std::memory_order_relaxed);
+    if (table == nullptr || id_to_term_.size() * 2 > table->mask + 1) {
+        Grow(shared, GetTableCapacity(id_to_term_.size()));
+    } else {
+        Insert(*table, id_to_term_[id], id);
+    }
+    return id;
+}
+
+TermId TermDictionary::Find(std::string_view term) const {
+    if (!shared_) {
+        return NO_TERM;
+    }
+    const Table* table = shared_->table.load(std::memory_order_acquire);
+    if (table == nullptr) {
+        return NO_TERM;
+    }
+    // Ids past the size of this copy belong to a newer copy and are skipped
+    for (size_t slot = std::hash<std::string_view>{}(term) & table->mask;; slot = (slot + 1) & table->mask) {
+        const TermId id = table->slots[slot].load(std::memory_order_acquire);
+        if (id == NO_TERM) {
+            return NO_TERM;
+        }
+        if (id < id_to_term_.size() && id_to_term_[id] == term) {
+            return id;
+        }
+    }
+}
+
+TermDictionary::Shared& TermDictionary::AcquireTail() {
+    size_t expected = id_to_term_.size();
+    if (shared_ && shared_->used.compare_exchange_strong(expected, expected + 1, std::memory_order_acq_rel)) {
+        return *shared_;
+    }
+    // The terms of this copy stay in the arena of the parent
+    auto shared = std::make_shared<Shared>();
+    shared->parent = std::move(shared_);
+    shared->used.store(id_to_term_.size() + 1, std::memory_order_relaxed);
+    shared_ = std::move(shared);
+    if (!id_to_term_.empty()) {
+        Grow(*shared_, GetTableCapacity(id_to_term_.size() + 1));
+    }
+    return *shared_;
+}
+
+std::string_view TermDictionary::Store(std::string_view term) {
+    if (term.empty()) {
+        return {};
+    }
+    Shared& shared = *shared_;
+    if (term.size() > shared.block_free) {
+        // Long terms get a block of their own, so the current block is not wasted
+        const size_t block_size = std::max(term.size(), ARENA_BLOCK_SIZE);
+        shared.blocks.push_back(std::make_unique<char[]>(block_size));
+        if (block_size == ARENA_BLOCK_SIZE) {
+            shared.block_pos = shared.blocks.back().get();
+            shared.block_free = block_size;
+        } else {
+            std::memcpy(shared.blocks.back().get(), term.data(), term.size());
+            return { shared.blocks.back().get(), term.size() };
+        }
+    }
+    std::memcpy(shared.block_pos, term.data(), term.size());
+    const std::string_view stored(shared.block_pos, term.size());
+    shared.block_pos += term.size();
+    shared.block_free -= term.size();
+    return stored;
+}
+
+void TermDictionary::Grow(Shared& shared, size_t capacity) {
+    auto table = std::make_unique<Table>(capacity);
+    for (TermId id = 0; id < id_to_term_.size(); ++id) {
+        Insert(*table, id_to_term_[id], id);
+    }
+    shared.table.store(table.get(), std::memory_order_release);
+    shared.tables.push_back(std::move(table));
+}
+
+void TermDictionary::Insert(const Table& table, std::string_view term, TermId id) {
+    size_t slot = std::hash<std::string_view>{}(term) & table.mask;
+    while (table.slots[slot].load(std::memory_order_relaxed) != NO_TERM) {
+        slot = (slot + 1) & table.mask;
+    }
+    table.slots[slot].store(id, std::memory_order_release);
+}
+
+void TermDictionary::Save(SnapshotWriter& writer) const {
+    writer.WriteStrings(id_to_term_);
+}
+
+void TermDictionary::Load(SnapshotReader& reader) {
+    for (const std::string_view term : reader.ReadStrings()) {
+        id_to_term_.push_back(term);
+    }
+    shared_ = std::make_shared<Shared>();
+    shared_->used.store(id_to_term_.size(), std::memory_order_relaxed);
+    Grow(*shared_, GetTableCapacity(id_to_term_.size()));
+}
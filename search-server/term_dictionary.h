@@ -0,0 +1,90 @@
+// Обьявление класса TermDictionary, хранящего по одной копии каждого уникального слова
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "pod_buffer.h"
+
+using TermId = uint32_t;
+
+class SnapshotReader;
+class SnapshotWriter;
+
+// Terms are only ever appended, so copies share one arena and one lookup
+// table and see the terms up to their own size. The copy whose size equals
+// the number of terms in the shared table interns in place, the table
+// entries it adds are invisible to the other copies. Any other copy that
+// interns a new term rebuilds a table of its own first. So a copy costs
+// O(1), and a series of copies that only the newest one changes, like the
+// versions of ConcurrentSearchServer, never rebuilds the table.
+class TermDictionary {
+public:
+    static constexpr TermId NO_TERM = UINT32_MAX;
+
+    TermDictionary() = default;
+    TermDictionary(const TermDictionary& other) = default;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+
+    // Returns id of the term, storing a copy of it on the first occurrence
+    TermId Intern(std::string_view term);
+
+    // Returns id of the term or NO_TERM if it was never interned
+    TermId Find(std::string_view term) const;
+
+    // View into the arena or the snapshot, valid while the dictionary is alive
+    std::string_view GetTerm(TermId id) const {
+        return id_to_term_[id];
+    }
+
+    size_t size() const {
+        return id_to_term_.size();
+    }
+
+    void Save(SnapshotWriter& writer) const;
+    // Loads into an empty dictionary. Terms stay in the mapped snapshot,
+    // only the lookup table is rebuilt
+    void Load(SnapshotReader& reader);
+
+private:
+    static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+    static constexpr size_t MIN_TABLE_CAPACITY = 64;
+
+    // Open-addressing table of term ids, at most half full. Queries of other
+    // copies probe it while the owner inserts, so the slots are atomic
+    struct Table {
+        explicit Table(size_t capacity);
+
+        std::unique_ptr<std::atomic<TermId>[]> slots;
+        size_t mask;
+    };
+
+    struct Shared {
+        // Terms interned by all copies, the copy of this size owns the tail
+        std::atomic<size_t> used = 0;
+        // Replaced tables are kept, a query of another copy may still probe one
+        std::vector<std::unique_ptr<Table>> tables;
+        std::atomic<const Table*> table = nullptr;
+        // Blocks are never moved or freed, the terms of the parent stay in its blocks
+        std::vector<std::unique_ptr<char[]>> blocks;
+        size_t block_free = 0;
+        char* block_pos = nullptr;
+        std::shared_ptr<const Shared> parent;
+    };
+
+    // Takes the tail of the shared table for one more term, building a table
+    // of this copy's terms first if another copy has appended to it
+    Shared& AcquireTail();
+    // Copies the term into the arena of the shared state this copy owns
+    std::string_view Store(std::string_view term);
+    // Smallest table for the terms that stays at most half full
+    static size_t GetTableCapacity(size_t term_count);
+    // Replaces the table with one holding the terms of this copy
+    void Grow(Shared& shared, size_t capacity);
+    static void Insert(const Table& table, std::string_view term, TermId id);
+
+    std::shared_ptr<Shared> shared_;
+    PodBuffer<std::string_view> id_to_term_;
+};
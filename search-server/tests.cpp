@@ -4,15 +4,31 @@
 #include <numeric>
 #include <execution>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include <random>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <iterator>
 
 #include "document.h"
 #include "read_input_functions.h"
 #include "request_queue.h"
 #include "search_server.h"
 #include "string_processing.h"
+#include "term_dictionary.h"
+#include "inverted_index.h"
+#include "score_accumulator.h"
+#include "concurrent_search_server.h"
+#include "exclusion_set.h"
+#include "query_executor.h"
+#include "metrics.h"
+#include "remove_duplicates.h"
 #include "tests.h"
-#include "log_duration.h"
 
 using namespace std::string_view_literals;
 using namespace std::string_literals;
@@ -215,14 +231,1523 @@ void TestPredicateFunc() {
     search_server.AddDocument(3, "ухоженный скворец евгений"s, DocumentStatus::BANNED, { 9 });
 
     int id = search_server.FindTopDocuments("ухоженный кот"s,
-        [](int document_id, DocumentStatus status, int rating) { return rating > 8; }).front().id;
+        [](int, DocumentStatus, int rating) { return rating > 8; }).front().id;
     ASSERT_HINT(id == 3, "Function-predicate using not correctly by rating condition."s);
 
     id = search_server.FindTopDocuments("ухоженный кот"s,
-        [](int document_id, DocumentStatus status, int rating) { return document_id == 1; }).front().id;
+        [](int document_id, DocumentStatus, int) { return document_id == 1; }).front().id;
     ASSERT_HINT(id == 1, "Function-predicate using not correctly by document id condition."s);
 }
 
+// Словарь хранит одну копию каждого слова, а сервер возвращает view на нее
+void TestTermDictionary() {
+    TermDictionary dictionary;
+    const TermId cat = dictionary.Intern("cat"s);
+    const TermId dog = dictionary.Intern("dog"sv);
+    ASSERT(cat != dog);
+    ASSERT_EQUAL(dictionary.Intern("cat"sv), cat);
+    ASSERT_EQUAL(dictionary.Find("dog"sv), dog);
+    ASSERT_EQUAL(dictionary.Find("bird"sv), TermDictionary::NO_TERM);
+    ASSERT_EQUAL(dictionary.size(), 2u);
+
+    const std::string_view stored_cat = dictionary.GetTerm(cat);
+    for (int i = 0; i < 100'000; ++i) {
+        dictionary.Intern(std::to_string(i));
+    }
+    ASSERT_HINT(stored_cat.data() == dictionary.GetTerm(cat).data(), "Interned words must not move."s);
+    ASSERT_EQUAL(dictionary.GetTerm(cat), "cat"sv);
+
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat and dog"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+    std::string query = "cat dog"s;
+    const auto [words, status] = search_server.MatchDocument(query, 1);
+    const auto [par_words, par_status] = search_server.MatchDocument(std::execution::par, query, 1);
+    query.assign(query.size(), 'x');
+    ASSERT_EQUAL(words, std::vector<std::string_view>({ "cat"sv, "dog"sv }));
+    ASSERT_EQUAL(par_words, std::vector<std::string_view>({ "cat"sv, "dog"sv }));
+    ASSERT(search_server.GetWordFrequencies(2).find("cat"sv)->first.data()
+        == search_server.GetWordFrequencies(1).find("cat"sv)->first.data());
+}
+
+// Удаление документов из индекса и повторное добавление с тем же id
+void TestRemoveDocument() {
+    PostingList postings;
+    for (DocOrdinal document = 0; document < 10; ++document) {
+        postings.Append(document, 1, 2);
+    }
+    const uint64_t deleted = uint64_t{ 1 } << 3;
+    PostingList merged;
+    merged.AppendFrom(postings, &deleted, 0);
+    ASSERT(postings.Contains(3));
+    ASSERT(!merged.Contains(3));
+    auto cursor = merged.begin();
+    cursor.SeekGEQ(3);
+    ASSERT_EQUAL(cursor.Document(), 4u);
+    ASSERT_EQUAL(merged.size(), 9u);
+
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "bird"sv, DocumentStatus::ACTUAL, { 3 });
+    search_server.RemoveDocument(std::execution::par, 2);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
+    ASSERT(search_server.GetWordFrequencies(2).empty());
+
+    const auto found = search_server.FindTopDocuments("cat"sv);
+    ASSERT_EQUAL(found.size(), 1u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT(std::abs(found[0].relevance - 0.5 * std::log(2.0)) < 1e-6);
+
+    search_server.AddDocument(2, "dog"sv, DocumentStatus::ACTUAL, { 2 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("dog"sv).size(), 2u);
+    ASSERT_EQUAL(search_server.FindTopDocuments(std::execution::par, "cat"sv).size(), 1u);
+    search_server.RemoveDocument(1);
+    search_server.RemoveDocument(2);
+    ASSERT(search_server.FindTopDocuments("cat dog"sv).empty());
+}
+
+// Накопитель релевантности в плотном режиме и в режиме хеш-таблицы
+void TestScoreAccumulator() {
+    for (const size_t posting_volume : { 1000u, 3u }) {
+        ScoreAccumulator accumulator;
+        for (int query = 0; query < 3; ++query) {
+            accumulator.Reset(0, 1000, posting_volume);
+            ASSERT(accumulator.GetMode() == (posting_volume == 3u
+                ? ScoreAccumulator::Mode::HASH : ScoreAccumulator::Mode::DENSE));
+            // More documents than expected make the hash table grow
+            for (DocOrdinal document = 0; document < 100; document += 2) {
+                accumulator.Add(document, 1.0);
+                accumulator.Add(document, 0.5);
+            }
+
+            std::map<DocOrdinal, double> scores;
+            accumulator.ForEach([&scores](DocOrdinal document, double relevance) {
+                scores[document] = relevance;
+            });
+            ASSERT_EQUAL(scores.size(), 50u);
+            ASSERT_EQUAL(scores.count(11), 0u);
+            ASSERT_EQUAL(scores.at(98), 1.5);
+        }
+    }
+
+    PooledScoreAccumulator outer;
+    {
+        PooledScoreAccumulator nested;
+        ASSERT_HINT(&*outer != &*nested, "Nested query must not share the accumulator."s);
+    }
+}
+
+// Параллельный поиск находит те же документы, что и последовательный
+void TestParallelSearchMatchesSequential() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto documents = Generator::GenerateQueries(generator, dictionary, 20'000, 30);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 7) });
+    }
+    for (int i = 0; i < 20; ++i) {
+        const std::string query = Generator::GenerateQuery(generator, dictionary, 10, 0.2);
+        const auto sequential = search_server.FindTopDocuments(std::execution::seq, query);
+        const auto parallel = search_server.FindTopDocuments(std::execution::par, query);
+        ASSERT_EQUAL(sequential.size(), parallel.size());
+        for (size_t j = 0; j < sequential.size(); ++j) {
+            ASSERT(std::abs(sequential[j].relevance - parallel[j].relevance) < 1e-6);
+            ASSERT_EQUAL(sequential[j].rating, parallel[j].rating);
+        }
+    }
+}
+
+// Количество результатов задается параметрами поиска
+void TestSearchOptionsResultCount() {
+    SearchServer search_server("и в на"s);
+    search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+    search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    search_server.AddDocument(3, "ухоженный скворец евгений"s, DocumentStatus::ACTUAL, { 9 });
+    for (int id = 4; id < 20; ++id) {
+        search_server.AddDocument(id, "кот"s, DocumentStatus::ACTUAL, { id });
+    }
+
+    const std::string query = "пушистый ухоженный кот"s;
+    const auto all = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, { 100 });
+    ASSERT_EQUAL(all.size(), 20u);
+    ASSERT(std::is_sorted(all.begin(), all.end(), [](const Document& lhs, const Document& rhs) {
+        return lhs.relevance > rhs.relevance + 1e-6
+            || (std::abs(lhs.relevance - rhs.relevance) < 1e-6 && lhs.rating > rhs.rating);
+    }));
+
+    for (const int count : { 0, 1, 3, 7 }) {
+        const auto top = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, { count });
+        const auto par_top = search_server.FindTopDocuments(std::execution::par, query, DocumentStatus::ACTUAL, { count });
+        ASSERT_EQUAL(top.size(), static_cast<size_t>(count));
+        ASSERT_EQUAL(par_top.size(), static_cast<size_t>(count));
+        for (int i = 0; i < count; ++i) {
+            ASSERT_EQUAL(top[i].id, all[i].id);
+            ASSERT_EQUAL(par_top[i].id, all[i].id);
+        }
+    }
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+
+    try {
+        search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, { -1 });
+        ASSERT_HINT(false, "Negative result count must be rejected."s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+// IDF слов пересчитывается после добавления и удаления документов
+void TestInverseDocumentFreqCache() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "dog"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(std::abs(search_server.FindTopDocuments("cat"sv)[0].relevance - 0.5 * std::log(2.0)) < 1e-9);
+
+    // The document count changes the IDF of words the new documents do not contain
+    search_server.AddDocument(3, "bird"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(4, "bird"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(std::abs(search_server.FindTopDocuments("cat"sv)[0].relevance - 0.5 * std::log(4.0)) < 1e-9);
+    ASSERT(std::abs(search_server.FindTopDocuments("dog"sv)[0].relevance - std::log(2.0)) < 1e-9);
+
+    search_server.RemoveDocument(3);
+    search_server.AddDocument(5, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(std::abs(search_server.FindTopDocuments("cat"sv)[0].relevance - std::log(2.0)) < 1e-9);
+    ASSERT(std::abs(search_server.FindTopDocuments(std::execution::par, "bird"sv)[0].relevance - std::log(4.0)) < 1e-9);
+}
+
+// MaxScore возвращает те же документы, что и полный перебор
+void TestMaxScoreMatchesExhaustive() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 200, 5);
+    const auto documents = Generator::GenerateQueries(generator, dictionary, 5'000, 20);
+    // Во втором индексе несколько сегментов, порог переходит из одного в другой
+    IndexOptions small_segments;
+    small_segments.segment_posting_count = 20'000;
+    for (const IndexOptions& index_options : { IndexOptions{}, small_segments }) {
+        SearchServer search_server(dictionary[0], index_options);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(static_cast<int>(i), documents[i],
+                i % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { static_cast<int>(i % 11) });
+        }
+        for (int id = 0; id < 5'000; id += 3) {
+            search_server.RemoveDocument(id);
+        }
+
+        const auto even_ids = [](int document_id, DocumentStatus, int) {
+            return document_id % 2 == 0;
+        };
+        for (int i = 0; i < 30; ++i) {
+            const std::string query = Generator::GenerateQuery(generator, dictionary, 1 + i % 10, 0.1);
+            for (const int count : { 1, 5, 50 }) {
+                const SearchOptions exhaustive{ count, QueryEvaluation::EXHAUSTIVE };
+                const SearchOptions max_score{ count, QueryEvaluation::MAX_SCORE };
+                const auto expected = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, exhaustive);
+                const auto found = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_score);
+                const auto par_found = search_server.FindTopDocuments(std::execution::par, query, DocumentStatus::ACTUAL, max_score);
+                const auto expected_even = search_server.FindTopDocuments(query, even_ids, exhaustive);
+                const auto found_even = search_server.FindTopDocuments(query, even_ids, max_score);
+                ASSERT_EQUAL(found.size(), expected.size());
+                ASSERT_EQUAL(par_found.size(), expected.size());
+                ASSERT_EQUAL(found_even.size(), expected_even.size());
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    ASSERT_EQUAL(found[j].id, expected[j].id);
+                    ASSERT_EQUAL(par_found[j].id, expected[j].id);
+                    ASSERT(std::abs(found[j].relevance - expected[j].relevance) < 1e-9);
+                }
+                for (size_t j = 0; j < expected_even.size(); ++j) {
+                    ASSERT_EQUAL(found_even[j].id, expected_even[j].id);
+                }
+            }
+        }
+    }
+}
+
+// Сжатые списки документов ведут себя так же, как несжатые
+void TestCompressedPostings() {
+    PostingList flat(PostingFormat::FLAT);
+    PostingList compressed(PostingFormat::COMPRESSED);
+    for (DocOrdinal document = 5; document < 5'000; document += 3) {
+        flat.Append(document, document % 4 + 1, 10);
+        compressed.Append(document, document % 4 + 1, 10);
+    }
+    ASSERT_EQUAL(flat.size(), compressed.size());
+    ASSERT_EQUAL(flat.MaxTermFreq(), compressed.MaxTermFreq());
+    ASSERT(compressed.MemoryUsage() < flat.MemoryUsage());
+
+    const auto assert_equal_lists = [](const PostingList& lhs, const PostingList& rhs) {
+        for (DocOrdinal document = 0; document < 5'010; ++document) {
+            ASSERT_EQUAL(lhs.Contains(document), rhs.Contains(document));
+        }
+        auto lhs_posting = lhs.begin();
+        auto rhs_posting = rhs.begin();
+        for (; !lhs_posting.AtEnd(); lhs_posting.Next(), rhs_posting.Next()) {
+            ASSERT(!rhs_posting.AtEnd());
+            ASSERT_EQUAL(lhs_posting.Document(), rhs_posting.Document());
+            ASSERT_EQUAL(lhs_posting.TermFreq(), rhs_posting.TermFreq());
+        }
+        ASSERT(rhs_posting.AtEnd());
+
+        for (DocOrdinal target = 0; target < 5'010; target += 97) {
+            auto lhs_seek = lhs.begin();
+            auto rhs_seek = rhs.begin();
+            lhs_seek.SeekGEQ(target);
+            rhs_seek.SeekGEQ(target);
+            ASSERT_EQUAL(lhs_seek.AtEnd(), rhs_seek.AtEnd());
+            if (!lhs_seek.AtEnd()) {
+                ASSERT_EQUAL(lhs_seek.Document(), rhs_seek.Document());
+                // A copied cursor continues from the same place
+                auto copy = rhs_seek;
+                copy.Next();
+                lhs_seek.Next();
+                ASSERT_EQUAL(lhs_seek.AtEnd(), copy.AtEnd());
+            }
+        }
+    };
+    assert_equal_lists(flat, compressed);
+    // Merging drops the postings of deleted documents
+    std::vector<uint64_t> deleted(5'000 / 64 + 1);
+    for (DocOrdinal document = 5; document < 5'000; document += 7) {
+        deleted[document / 64] |= uint64_t{ 1 } << (document % 64);
+    }
+    PostingList merged_flat(PostingFormat::FLAT);
+    PostingList merged_compressed(PostingFormat::COMPRESSED);
+    merged_flat.AppendFrom(flat, deleted.data(), 0);
+    merged_compressed.AppendFrom(compressed, deleted.data(), 0);
+    ASSERT(merged_compressed.size() < compressed.size());
+    ASSERT(!merged_compressed.Contains(26));
+    assert_equal_lists(merged_flat, merged_compressed);
+
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto documents = Generator::GenerateQueries(generator, dictionary, 3'000, 30);
+    SearchServer flat_server(dictionary[0], PostingFormat::FLAT);
+    SearchServer compressed_server(dictionary[0], PostingFormat::COMPRESSED);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        flat_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 7) });
+        compressed_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 7) });
+    }
+    for (int id = 0; id < 3'000; id += 4) {
+        flat_server.RemoveDocument(id);
+        compressed_server.RemoveDocument(id);
+    }
+    ASSERT(compressed_server.GetIndexMemoryUsage() < flat_server.GetIndexMemoryUsage());
+    for (int i = 0; i < 20; ++i) {
+        const std::string query = Generator::GenerateQuery(generator, dictionary, 8, 0.2);
+        for (const auto evaluation : { QueryEvaluation::EXHAUSTIVE, QueryEvaluation::MAX_SCORE }) {
+            const SearchOptions options{ 10, evaluation };
+            const auto expected = flat_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+            const auto found = compressed_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_EQUAL(found[j].id, expected[j].id);
+                ASSERT_EQUAL(found[j].relevance, expected[j].relevance);
+            }
+        }
+        const int id = 1 + 4 * i;
+        ASSERT_EQUAL(std::get<0>(compressed_server.MatchDocument(query, id)),
+            std::get<0>(flat_server.MatchDocument(query, id)));
+    }
+}
+
+// Множество исключенных документов одинаково в плотном и разреженном виде
+void TestExclusionSet() {
+    for (const size_t expected_count : { size_t{ 1 }, size_t{ 1'000 } }) {
+        ExclusionSet excluded;
+        excluded.Reset(100, 10'100, expected_count);
+        ASSERT(excluded.empty());
+        ASSERT(!excluded.Contains(100));
+        for (DocOrdinal document = 10'099; document >= 100; document -= 13) {
+            excluded.Add(document);
+            excluded.Add(document);
+        }
+        excluded.Seal();
+        ASSERT(!excluded.empty());
+        for (DocOrdinal document = 100; document < 10'100; ++document) {
+            ASSERT_EQUAL(excluded.Contains(document), (10'099 - document) % 13 == 0);
+        }
+    }
+
+    // Множество потока переиспользуется очищенным, вложенный запрос получает свое
+    for (int i = 0; i < 2; ++i) {
+        PooledExclusionSet outer;
+        outer->Reset(0, 1'000, 1'000);
+        ASSERT(!outer->Contains(7));
+        outer->Add(7);
+        outer->Seal();
+        {
+            PooledExclusionSet nested;
+            ASSERT(&*nested != &*outer);
+            nested->Reset(0, 1'000, 1);
+            nested->Seal();
+            ASSERT(!nested->Contains(7));
+        }
+        ASSERT(outer->Contains(7));
+    }
+
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "cat in the city"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "dog in the city"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "cat and dog"sv, DocumentStatus::ACTUAL, { 3 });
+    search_server.AddDocument(4, "bird in the park"sv, DocumentStatus::ACTUAL, { 4 });
+    for (const auto evaluation : { QueryEvaluation::EXHAUSTIVE, QueryEvaluation::MAX_SCORE }) {
+        const SearchOptions options{ 5, evaluation };
+        const auto found = search_server.FindTopDocuments("cat dog city -dog -park"sv, DocumentStatus::ACTUAL, options);
+        ASSERT_EQUAL(found.size(), 1u);
+        ASSERT_EQUAL(found[0].id, 1);
+        ASSERT(search_server.FindTopDocuments("city -city"sv, DocumentStatus::ACTUAL, options).empty());
+        ASSERT_EQUAL(search_server.FindTopDocuments(std::execution::par, "city -cat"sv,
+            DocumentStatus::ACTUAL, options).size(), 1u);
+    }
+}
+
+// Пакетное добавление дает тот же индекс, что и добавление документов по одному
+void TestAddDocuments() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto texts = Generator::GenerateQueries(generator, dictionary, 2'000, 30);
+    std::vector<DocumentToAdd> documents;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        documents.push_back({ static_cast<int>(i * 3), texts[i], static_cast<DocumentStatus>(i % 3),
+            { static_cast<int>(i % 7), -2 } });
+    }
+
+    SearchServer expected_server(dictionary[0]);
+    for (const auto& document : documents) {
+        expected_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    SearchServer seq_server(dictionary[0]);
+    seq_server.AddDocuments(documents);
+    SearchServer par_server(dictionary[0], PostingFormat::COMPRESSED);
+    par_server.AddDocuments(std::execution::par, documents);
+
+    for (const SearchServer* server : { &seq_server, &par_server }) {
+        ASSERT_EQUAL(server->GetDocumentCount(), expected_server.GetDocumentCount());
+        for (const auto& document : documents) {
+            const auto& words = server->GetWordFrequencies(document.id);
+            const auto& expected_words = expected_server.GetWordFrequencies(document.id);
+            ASSERT(std::equal(words.begin(), words.end(), expected_words.begin(), expected_words.end()));
+        }
+        for (int i = 0; i < 20; ++i) {
+            const std::string query = Generator::GenerateQuery(generator, dictionary, 6, 0.2);
+            for (const auto status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = expected_server.FindTopDocuments(query, status);
+                const auto found = server->FindTopDocuments(query, status);
+                ASSERT_EQUAL(found.size(), expected.size());
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    ASSERT_EQUAL(found[j].id, expected[j].id);
+                    ASSERT_EQUAL(found[j].rating, expected[j].rating);
+                    ASSERT(std::abs(found[j].relevance - expected[j].relevance) < 1e-9);
+                }
+            }
+        }
+    }
+
+    // Документы до первого некорректного добавляются, затем выбрасывается исключение
+    const std::vector<std::vector<DocumentToAdd>> invalid_batches = {
+        { { 10, "white cat"sv, DocumentStatus::ACTUAL, { 1 } }, { 11, "black dog"sv, DocumentStatus::ACTUAL, { 1 } },
+            { 1, "fluffy cat"sv, DocumentStatus::ACTUAL, { 1 } }, { 12, "bird"sv, DocumentStatus::ACTUAL, { 1 } } },
+        { { 10, "white cat"sv, DocumentStatus::ACTUAL, { 1 } }, { 11, "black dog"sv, DocumentStatus::ACTUAL, { 1 } },
+            { 11, "fluffy cat"sv, DocumentStatus::ACTUAL, { 1 } }, { 12, "bird"sv, DocumentStatus::ACTUAL, { 1 } } },
+        { { 10, "white cat"sv, DocumentStatus::ACTUAL, { 1 } }, { 11, "black dog"sv, DocumentStatus::ACTUAL, { 1 } },
+            { 13, "fluffy ca\x12t"sv, DocumentStatus::ACTUAL, { 1 } }, { -1, "bird"sv, DocumentStatus::ACTUAL, { 1 } } },
+    };
+    for (const auto& batch : invalid_batches) {
+        SearchServer search_server("and"s);
+        search_server.AddDocument(1, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+        try {
+            search_server.AddDocuments(std::execution::par, batch);
+            ASSERT_HINT(false, "AddDocuments must throw on an invalid document"s);
+        } catch (const std::invalid_argument&) {
+        }
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+        ASSERT_EQUAL(search_server.FindTopDocuments("cat dog fluffy bird"sv).size(), 3u);
+        ASSERT(search_server.GetWordFrequencies(12).empty());
+    }
+}
+
+// Загруженный снимок отвечает на запросы так же, как сохраненная поисковая система
+void TestSnapshot() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto texts = Generator::GenerateQueries(generator, dictionary, 2'000, 30);
+    const std::string path = "search_server_test.snapshot"s;
+
+    for (const auto format : { PostingFormat::FLAT, PostingFormat::COMPRESSED }) {
+        SearchServer search_server(dictionary[0] + " "s + dictionary[1], format);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            search_server.AddDocument(static_cast<int>(i), texts[i], static_cast<DocumentStatus>(i % 2),
+                { static_cast<int>(i % 5) });
+        }
+        for (int id = 0; id < 2'000; id += 3) {
+            search_server.RemoveDocument(id);
+        }
+        search_server.SaveSnapshot(path);
+        const auto loaded_server = SearchServer::LoadSnapshot(path);
+
+        ASSERT_EQUAL(loaded_server.GetDocumentCount(), search_server.GetDocumentCount());
+        ASSERT(std::equal(loaded_server.begin(), loaded_server.end(), search_server.begin(), search_server.end()));
+        ASSERT_EQUAL(loaded_server.GetIndexMemoryUsage() > 0, true);
+        const auto assert_equal_servers = [&](const SearchServer& lhs, const SearchServer& rhs) {
+            for (const int id : rhs) {
+                const auto& words = lhs.GetWordFrequencies(id);
+                const auto& expected_words = rhs.GetWordFrequencies(id);
+                ASSERT(std::equal(words.begin(), words.end(), expected_words.begin(), expected_words.end()));
+            }
+            for (int i = 0; i < 20; ++i) {
+                const std::string query = Generator::GenerateQuery(generator, dictionary, 6, 0.2);
+                const auto expected = rhs.FindTopDocuments(query, DocumentStatus::BANNED);
+                const auto found = lhs.FindTopDocuments(query, DocumentStatus::BANNED);
+                ASSERT_EQUAL(found.size(), expected.size());
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    ASSERT_EQUAL(found[j].id, expected[j].id);
+                    ASSERT_EQUAL(found[j].relevance, expected[j].relevance);
+                }
+                const int id = 3 * i + 4;
+                ASSERT(lhs.MatchDocument(query, id) == rhs.MatchDocument(query, id));
+            }
+        };
+        assert_equal_servers(loaded_server, search_server);
+
+        // Загруженный индекс можно изменять
+        auto changed_server = SearchServer::LoadSnapshot(path);
+        for (SearchServer* server : { &search_server, &changed_server }) {
+            server->AddDocument(5'000, texts[0], DocumentStatus::BANNED, { 7 });
+            server->RemoveDocument(1);
+            server->RemoveDocument(2);
+        }
+        assert_equal_servers(changed_server, search_server);
+        ASSERT_EQUAL(loaded_server.GetDocumentCount() - 1, changed_server.GetDocumentCount());
+    }
+
+    // Испорченный снимок либо не загружается, либо загружается без выхода за границы массивов
+    for (const auto format : { PostingFormat::FLAT, PostingFormat::COMPRESSED }) {
+        SearchServer search_server(dictionary[0], format);
+        for (size_t i = 0; i < 200; ++i) {
+            search_server.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, { 1 });
+        }
+        search_server.SaveSnapshot(path);
+        std::string bytes;
+        {
+            std::ifstream in(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        for (size_t position = 16; position + 4 <= bytes.size(); position += bytes.size() / 300) {
+            std::string corrupted = bytes;
+            std::fill(corrupted.begin() + position, corrupted.begin() + position + 4, '\xFF');
+            std::ofstream(path, std::ios::binary | std::ios::trunc) << corrupted;
+            try {
+                const auto loaded_server = SearchServer::LoadSnapshot(path);
+                for (const int id : loaded_server) {
+                    loaded_server.GetWordFrequencies(id);
+                }
+                loaded_server.FindTopDocuments(texts[0]);
+            } catch (const std::runtime_error&) {
+            }
+        }
+    }
+
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << "not a snapshot"s;
+    }
+    try {
+        SearchServer::LoadSnapshot(path);
+        ASSERT_HINT(false, "Loading an invalid snapshot must throw"s);
+    } catch (const std::runtime_error&) {
+    }
+    std::remove(path.c_str());
+}
+
+// Изменения из журнала восстанавливаются поверх последнего снимка
+void TestMutationLog() {
+    const std::string log_path = "search_server_test.log"s;
+    const std::string snapshot_path = "search_server_test.snapshot"s;
+    std::remove(log_path.c_str());
+    const auto assert_same_documents = [](const SearchServer& lhs, const SearchServer& rhs) {
+        ASSERT(std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()));
+        const auto expected = rhs.FindTopDocuments("cat dog parrot"sv, DocumentStatus::ACTUAL, SearchOptions{ 100 });
+        const auto found = lhs.FindTopDocuments("cat dog parrot"sv, DocumentStatus::ACTUAL, SearchOptions{ 100 });
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].rating, expected[i].rating);
+            ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+        }
+    };
+
+    for (const auto policy : { LogSyncPolicy::EVERY_BATCH, LogSyncPolicy::INTERVAL, LogSyncPolicy::NEVER }) {
+        std::remove(log_path.c_str());
+        SearchServer search_server("and"s);
+        search_server.OpenMutationLog(log_path, { policy, std::chrono::milliseconds(5) });
+        for (int id = 0; id < 100; ++id) {
+            search_server.AddDocument(id, id % 2 ? "cat and dog"s : "parrot "s + std::to_string(id),
+                static_cast<DocumentStatus>(id % 3 == 0), { id, 1 });
+        }
+        search_server.AddDocuments({ { 200, "fluffy cat"sv, DocumentStatus::ACTUAL, { 5 } },
+            { 201, "dog"sv, DocumentStatus::ACTUAL, {} } });
+        for (int id = 0; id < 100; id += 7) {
+            search_server.RemoveDocument(id);
+        }
+        search_server.SyncMutationLog();
+
+        SearchServer replayed_server("and"s);
+        replayed_server.OpenMutationLog(log_path);
+        assert_same_documents(replayed_server, search_server);
+
+        // Снимок сокращает журнал, после него записываются только новые изменения
+        search_server.SaveSnapshot(snapshot_path);
+        search_server.AddDocument(300, "dog parrot"sv, DocumentStatus::ACTUAL, { 3 });
+        search_server.RemoveDocument(1);
+        search_server.SyncMutationLog();
+        {
+            auto restored_server = SearchServer::LoadSnapshot(snapshot_path);
+            restored_server.OpenMutationLog(log_path);
+            assert_same_documents(restored_server, search_server);
+        }
+    }
+
+    // Записи, уже вошедшие в снимок, пропускаются, а оборванная запись в конце отбрасывается
+    std::remove(log_path.c_str());
+    {
+        SearchServer search_server("and"s);
+        search_server.OpenMutationLog(log_path);
+        search_server.AddDocument(1, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+        search_server.AddDocument(2, "dog"sv, DocumentStatus::ACTUAL, { 2 });
+        search_server.SyncMutationLog();
+        std::filesystem::copy_file(log_path, log_path + ".copy"s, std::filesystem::copy_options::overwrite_existing);
+        search_server.SaveSnapshot(snapshot_path);
+    }
+    // Как если бы процесс завершился между сохранением снимка и сокращением журнала
+    std::filesystem::rename(log_path + ".copy"s, log_path);
+    {
+        auto search_server = SearchServer::LoadSnapshot(snapshot_path);
+        search_server.OpenMutationLog(log_path);
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
+        search_server.AddDocument(3, "parrot"sv, DocumentStatus::ACTUAL, { 3 });
+    }
+    {
+        std::ofstream out(log_path, std::ios::binary | std::ios::app);
+        out << "torn"s;
+    }
+    {
+        auto search_server = SearchServer::LoadSnapshot(snapshot_path);
+        search_server.OpenMutationLog(log_path);
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+        search_server.AddDocument(4, "dog"sv, DocumentStatus::ACTUAL, { 4 });
+    }
+    {
+        auto search_server = SearchServer::LoadSnapshot(snapshot_path);
+        search_server.OpenMutationLog(log_path);
+        ASSERT_EQUAL(search_server.GetDocumentCount(), 4);
+        ASSERT_EQUAL(search_server.FindTopDocuments("dog"sv).size(), 2u);
+    }
+    std::remove(log_path.c_str());
+    std::remove(snapshot_path.c_str());
+}
+
+// Копии и опубликованные версии не видят изменений, сделанных после них
+void TestConcurrentSearchServer() {
+    SearchServer search_server("and"s);
+    for (int id = 0; id < 50; ++id) {
+        search_server.AddDocument(id, id % 2 ? "white cat"sv : "black dog"sv, DocumentStatus::ACTUAL, { id });
+    }
+    SearchServer copy = search_server;
+    search_server.AddDocument(100, "white parrot"sv, DocumentStatus::ACTUAL, { 1 });
+    copy.AddDocument(100, "black cat"sv, DocumentStatus::ACTUAL, { 2 });
+    copy.AddDocument(101, "white cat"sv, DocumentStatus::ACTUAL, { 3 });
+    search_server.RemoveDocument(1);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 50);
+    ASSERT_EQUAL(copy.GetDocumentCount(), 52);
+    ASSERT_EQUAL(search_server.FindTopDocuments("parrot"sv).size(), 1u);
+    ASSERT(copy.FindTopDocuments("parrot"sv).empty());
+    ASSERT_EQUAL(copy.FindTopDocuments("cat"sv, DocumentStatus::ACTUAL, SearchOptions{ 100 }).size(), 27u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"sv, DocumentStatus::ACTUAL, SearchOptions{ 100 }).size(), 24u);
+
+    ConcurrentSearchServer concurrent_server(search_server);
+    const auto pinned_version = concurrent_server.GetVersion();
+    concurrent_server.AddDocument(200, "black parrot"sv, DocumentStatus::ACTUAL, { 1 });
+    concurrent_server.RemoveDocument(0);
+    ASSERT_EQUAL(pinned_version->GetDocumentCount(), 50);
+    ASSERT_EQUAL(pinned_version->FindTopDocuments("parrot"sv).size(), 1u);
+    ASSERT_EQUAL(concurrent_server.GetDocumentCount(), 50);
+    ASSERT_EQUAL(concurrent_server.FindTopDocuments("parrot"sv).size(), 2u);
+    try {
+        concurrent_server.RemoveDocument(0);
+        ASSERT_HINT(false, "Removing a missing document must throw"s);
+    } catch (const std::out_of_range&) {
+    }
+
+    // Изменения без читателей между ними публикуются одной версией при следующем чтении
+    const auto read_version = concurrent_server.GetVersion();
+    for (int id = 300; id < 310; ++id) {
+        concurrent_server.AddDocument(id, "grey parrot"sv, DocumentStatus::ACTUAL, { 1 });
+    }
+    const auto coalesced_version = concurrent_server.GetVersion();
+    ASSERT(coalesced_version != read_version);
+    ASSERT_EQUAL(coalesced_version->GetDocumentCount(), 60);
+    ASSERT(concurrent_server.GetVersion() == coalesced_version);
+    ASSERT_EQUAL(read_version->GetDocumentCount(), 50);
+    concurrent_server.RemoveDocuments({ 300, 301, 302, 303, 304, 305, 306, 307, 308, 309 });
+    ASSERT_EQUAL(concurrent_server.GetDocumentCount(), 50);
+
+    // Документы добавляются парами, поэтому любая версия содержит четное число новых документов
+    std::atomic<bool> is_writing = true;
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 2; ++reader) {
+        readers.emplace_back([&concurrent_server, &is_writing] {
+            do {
+                const auto version = concurrent_server.GetVersion();
+                const auto found = version->FindTopDocuments(std::execution::par, "green parrot"sv,
+                    DocumentStatus::ACTUAL, SearchOptions{ 1'000 });
+                ASSERT_EQUAL(version->GetDocumentCount() % 2, 0);
+                ASSERT_EQUAL(found.size() % 2, 0u);
+            } while (is_writing);
+        });
+    }
+    for (int id = 1'000; id < 1'400; id += 2) {
+        concurrent_server.Update([id](SearchServer& server) {
+            server.AddDocument(id, "green parrot"sv, DocumentStatus::ACTUAL, { 1 });
+            server.AddDocument(id + 1, "green cat"sv, DocumentStatus::ACTUAL, { 1 });
+        });
+        if (id % 100 == 0 && id > 1'000) {
+            concurrent_server.Update([id](SearchServer& server) {
+                server.RemoveDocument(id - 100);
+                server.RemoveDocument(id - 99);
+            });
+        }
+    }
+    is_writing = false;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQUAL(concurrent_server.GetDocumentCount(), 50 + 400 - 6);
+}
+
+// Версии делят словарь, страницы счетчиков слов и части отображения id документов,
+// но каждая видит только свои изменения
+void TestVersionsShareState() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 2'000, 8);
+    const auto texts = Generator::GenerateQueries(generator, dictionary, 3'000, 20);
+    IndexOptions index_options;
+    index_options.segment_posting_count = 5'000;
+    SearchServer expected_server(""s, index_options);
+    ConcurrentSearchServer concurrent_server(SearchServer(""s, index_options));
+
+    // Id идут вразнобой, чтобы части отображения id делились посередине
+    std::vector<int> ids(texts.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    std::shuffle(ids.begin(), ids.end(), generator);
+    std::vector<std::pair<std::shared_ptr<const SearchServer>, int>> pinned_versions;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        expected_server.AddDocument(ids[i], texts[i], DocumentStatus::ACTUAL, { 1 });
+        concurrent_server.AddDocument(ids[i], texts[i], DocumentStatus::ACTUAL, { 1 });
+        if (i % 7 == 3) {
+            expected_server.RemoveDocument(ids[i - 2]);
+            concurrent_server.RemoveDocument(ids[i - 2]);
+        }
+        if (i % 500 == 0) {
+            pinned_versions.emplace_back(concurrent_server.GetVersion(), expected_server.GetDocumentCount());
+        }
+    }
+    const auto version = concurrent_server.GetVersion();
+    ASSERT(std::equal(version->begin(), version->end(), expected_server.begin(), expected_server.end()));
+    for (int i = 0; i < 20; ++i) {
+        const std::string query = Generator::GenerateQuery(generator, dictionary, 5, 0.2);
+        const auto expected = expected_server.FindTopDocuments(query);
+        const auto found = version->FindTopDocuments(query);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(found[j].id, expected[j].id);
+            ASSERT_EQUAL(found[j].relevance, expected[j].relevance);
+        }
+    }
+    for (const auto& [pinned_version, document_count] : pinned_versions) {
+        ASSERT_EQUAL(pinned_version->GetDocumentCount(), document_count);
+        ASSERT_EQUAL(std::distance(pinned_version->begin(), pinned_version->end()), document_count);
+    }
+
+    // Копии, добавившие разные новые слова, не видят слов друг друга
+    SearchServer copy = *version;
+    concurrent_server.AddDocument(10'000, "Zebra"sv, DocumentStatus::ACTUAL, { 1 });
+    copy.AddDocument(10'000, "Quokka"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(copy.FindTopDocuments("Zebra"sv).empty());
+    ASSERT(concurrent_server.FindTopDocuments("Quokka"sv).empty());
+    ASSERT(version->FindTopDocuments("Zebra Quokka"sv).empty());
+    copy.AddDocument(10'001, "Zebra Zebra Quokka"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(copy.FindTopDocuments("Zebra"sv).front().id, 10'001);
+    ASSERT_EQUAL(copy.FindTopDocuments("Quokka"sv).size(), 2u);
+    ASSERT_EQUAL(concurrent_server.FindTopDocuments("Zebra"sv).size(), 1u);
+    ASSERT_EQUAL(concurrent_server.GetVersion()->GetWordFrequencies(10'000).begin()->first, "Zebra"sv);
+}
+
+// Индекс из многих сливающихся сегментов находит то же, что и индекс из одного
+void TestSegmentedIndex() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto texts = Generator::GenerateQueries(generator, dictionary, 3'000, 30);
+    const std::string path = "search_server_test.snapshot"s;
+
+    for (const auto format : { PostingFormat::FLAT, PostingFormat::COMPRESSED }) {
+        IndexOptions index_options(format);
+        index_options.segment_posting_count = 500;
+        index_options.merge_factor = 3;
+        SearchServer expected_server(dictionary[0], format);
+        SearchServer search_server(dictionary[0], index_options);
+        std::vector<DocumentToAdd> batch;
+        for (size_t i = 0; i < texts.size(); ++i) {
+            const int id = static_cast<int>(i);
+            const auto status = static_cast<DocumentStatus>(i % 2);
+            expected_server.AddDocument(id, texts[i], status, { id % 7 });
+            if (i < 1'000) {
+                search_server.AddDocument(id, texts[i], status, { id % 7 });
+            } else {
+                batch.push_back({ id, texts[i], status, { id % 7 } });
+            }
+        }
+        search_server.AddDocuments(batch);
+        for (int id = 0; id < 3'000; id += 5) {
+            expected_server.RemoveDocument(id);
+            search_server.RemoveDocument(id);
+        }
+        // Версия, снятая до слияний, отвечает так же, как и после них
+        const SearchServer version(search_server);
+
+        const auto assert_same_results = [&](const SearchServer& server) {
+            for (int i = 0; i < 20; ++i) {
+                const std::string query = Generator::GenerateQuery(generator, dictionary, 6, 0.2);
+                for (const auto evaluation : { QueryEvaluation::EXHAUSTIVE, QueryEvaluation::MAX_SCORE }) {
+                    const SearchOptions options{ 10, evaluation };
+                    const auto expected = expected_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+                    const auto found = server.FindTopDocuments(query, DocumentStatus::ACTUAL, options);
+                    const auto par_found = server.FindTopDocuments(std::execution::par, query,
+                        DocumentStatus::ACTUAL, options);
+                    ASSERT_EQUAL(found.size(), expected.size());
+                    ASSERT_EQUAL(par_found.size(), expected.size());
+                    for (size_t j = 0; j < expected.size(); ++j) {
+                        ASSERT_EQUAL(found[j].id, expected[j].id);
+                        ASSERT_EQUAL(par_found[j].id, expected[j].id);
+                        ASSERT(std::abs(found[j].relevance - expected[j].relevance) < 1e-9);
+                    }
+                }
+                const int id = 5 * i + 2;
+                ASSERT(server.MatchDocument(query, id) == expected_server.MatchDocument(query, id));
+            }
+        };
+        assert_same_results(search_server);
+        search_server.WaitForIndexMerges();
+        assert_same_results(search_server);
+        assert_same_results(version);
+
+        // Слияния продолжаются после новых изменений и переживают снимок
+        for (int id = 1; id < 3'000; id += 5) {
+            expected_server.RemoveDocument(id);
+            search_server.RemoveDocument(id);
+        }
+        for (int id = 3'000; id < 3'400; ++id) {
+            expected_server.AddDocument(id, texts[id - 3'000], DocumentStatus::ACTUAL, { 1 });
+            search_server.AddDocument(id, texts[id - 3'000], DocumentStatus::ACTUAL, { 1 });
+        }
+        search_server.WaitForIndexMerges();
+        assert_same_results(search_server);
+        search_server.SaveSnapshot(path);
+        auto loaded_server = SearchServer::LoadSnapshot(path);
+        assert_same_results(loaded_server);
+        // Параметры индекса сохраняются в снимке
+        ASSERT(loaded_server.GetIndexOptions().posting_format == format);
+        ASSERT_EQUAL(loaded_server.GetIndexOptions().segment_posting_count, 500u);
+        ASSERT_EQUAL(loaded_server.GetIndexOptions().merge_factor, 3u);
+        ASSERT_EQUAL(loaded_server.GetIndexOptions().vacuum_deleted_share, index_options.vacuum_deleted_share);
+        for (int id = 3'400; id < 4'000; ++id) {
+            expected_server.AddDocument(id, texts[id - 3'000], DocumentStatus::ACTUAL, { 2 });
+            loaded_server.AddDocument(id, texts[id - 3'000], DocumentStatus::ACTUAL, { 2 });
+        }
+        loaded_server.RemoveDocument(3'001);
+        expected_server.RemoveDocument(3'001);
+        loaded_server.WaitForIndexMerges();
+        assert_same_results(loaded_server);
+    }
+    std::filesystem::remove(path);
+}
+
+// Удаленные документы вычищаются из сегментов, результаты не меняются
+void TestRemoveDocuments() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto texts = Generator::GenerateQueries(generator, dictionary, 3'000, 30);
+
+    IndexOptions index_options;
+    index_options.segment_posting_count = 1'000;
+    SearchServer search_server(dictionary[0], index_options);
+    SearchServer expected_server(dictionary[0]);
+    std::vector<int> removed_ids;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const int id = static_cast<int>(i);
+        search_server.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id % 7 });
+        if (id % 5 == 0) {
+            expected_server.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id % 7 });
+        } else {
+            removed_ids.push_back(id);
+        }
+    }
+    search_server.WaitForIndexMerges();
+    const size_t memory_usage = search_server.GetIndexMemoryUsage();
+
+    search_server.RemoveDocuments(removed_ids);
+    search_server.WaitForIndexMerges();
+    ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount());
+    ASSERT(search_server.GetIndexMemoryUsage() < memory_usage / 2);
+    for (int i = 0; i < 20; ++i) {
+        const std::string query = Generator::GenerateQuery(generator, dictionary, 6, 0.2);
+        const auto expected = expected_server.FindTopDocuments(query);
+        const auto found = search_server.FindTopDocuments(std::execution::par, query);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(found[j].id, expected[j].id);
+            ASSERT(std::abs(found[j].relevance - expected[j].relevance) < 1e-9);
+        }
+    }
+
+    // Слово, оставшееся без документов, не находится и не ломает IDF
+    search_server.AddDocument(5'000, "unique"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(5'001, "unique words"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.RemoveDocument(std::execution::par, 5'000);
+    search_server.RemoveDocument(5'001);
+    ASSERT(search_server.FindTopDocuments("unique"sv).empty());
+
+    // Документы до отсутствующего удаляются
+    try {
+        search_server.RemoveDocuments({ 0, 5'002, 5 });
+        ASSERT_HINT(false, "Removing a missing document must throw"s);
+    } catch (const std::out_of_range&) {
+    }
+    ASSERT(search_server.GetWordFrequencies(0).empty());
+    ASSERT(!search_server.GetWordFrequencies(5).empty());
+}
+
+// Пакетный поиск находит то же, что и поиск по одному запросу
+void TestFindTopDocumentsBatch() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto texts = Generator::GenerateQueries(generator, dictionary, 6'000, 30);
+
+    IndexOptions index_options;
+    index_options.segment_posting_count = 20'000;
+    SearchServer search_server(dictionary[0], index_options);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const int id = static_cast<int>(i);
+        search_server.AddDocument(id, texts[i], id % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+            { id % 11 });
+    }
+    for (int id = 1; id < 6'000; id += 7) {
+        search_server.RemoveDocument(id);
+    }
+
+    std::vector<std::string> queries;
+    for (int i = 0; i < 300; ++i) {
+        queries.push_back(Generator::GenerateQuery(generator, dictionary, 8, 0.2));
+    }
+    queries.push_back(""s);
+    queries.push_back("-"s + dictionary[1]);
+    queries.push_back(dictionary[1] + " "s + dictionary[1] + " -"s + dictionary[1]);
+    queries.push_back(dictionary[2] + " "s + dictionary[2]);
+
+    const auto assert_same = [](const std::vector<Document>& found, const std::vector<Document>& expected) {
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(found[j].id, expected[j].id);
+            ASSERT_EQUAL(found[j].rating, expected[j].rating);
+            ASSERT(found[j].relevance == expected[j].relevance);
+        }
+    };
+    const std::vector<std::string_view> raw_queries(queries.begin(), queries.end());
+    SearchOptions options;
+    options.max_result_count = 20;
+    const auto found = search_server.FindTopDocumentsBatch(raw_queries, DocumentStatus::BANNED, options);
+    const auto processed = ProcessQueries(search_server, queries);
+    ASSERT_EQUAL(found.size(), queries.size());
+    ASSERT_EQUAL(processed.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        assert_same(found[i], search_server.FindTopDocuments(queries[i], DocumentStatus::BANNED, options));
+        assert_same(processed[i], search_server.FindTopDocuments(queries[i]));
+    }
+    // Следующий пакет потока получает строки окна предыдущего очищенными
+    const auto found_again = search_server.FindTopDocumentsBatch(raw_queries, DocumentStatus::BANNED, options);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        assert_same(found_again[i], found[i]);
+    }
+    ASSERT(search_server.FindTopDocumentsBatch({}).empty());
+}
+
+// Результаты запросов читаются по мере готовности в порядке запросов
+void TestProcessQueriesJoined() {
+    std::mt19937 generator;
+    const auto dictionary = Generator::GenerateDictionary(generator, 300, 6);
+    const auto texts = Generator::GenerateQueries(generator, dictionary, 2'000, 30);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, { 1 });
+    }
+    const auto queries = Generator::GenerateQueries(generator, dictionary, 1'000, 5);
+
+    std::vector<Document> expected;
+    for (const auto& documents : ProcessQueries(search_server, queries)) {
+        expected.insert(expected.end(), documents.begin(), documents.end());
+    }
+    for (const size_t max_batches_in_flight : { 1, 3 }) {
+        size_t index = 0;
+        for (const Document& document : JoinedQueryResults(search_server, queries, max_batches_in_flight)) {
+            ASSERT(index < expected.size());
+            ASSERT_EQUAL(document.id, expected[index].id);
+            ASSERT(document.relevance == expected[index].relevance);
+            ++index;
+        }
+        ASSERT_EQUAL(index, expected.size());
+    }
+    auto joined = ProcessQueriesJoined(search_server, queries);
+    ASSERT_EQUAL(static_cast<size_t>(std::distance(joined.begin(), joined.end())), expected.size());
+
+    // Результаты хранят запросы и перемещаются вместе с запущенными пакетами
+    JoinedQueryResults moved = ProcessQueriesJoined(search_server, std::vector<std::string>(queries));
+    JoinedQueryResults target(std::move(moved));
+    moved = ProcessQueriesJoined(search_server, { queries.front() });
+    ASSERT_EQUAL(static_cast<size_t>(std::distance(target.begin(), target.end())), expected.size());
+    ASSERT_EQUAL(static_cast<size_t>(std::distance(moved.begin(), moved.end())),
+        ProcessQueries(search_server, { queries.front() }).front().size());
+
+    // Читатель в единственном рабочем потоке пула выполняет пакеты сам, а не ждет их
+    QueryExecutorOptions single_worker;
+    single_worker.worker_count = 1;
+    SearchServer pooled_server(search_server);
+    pooled_server.SetQueryExecutor(std::make_shared<QueryExecutor>(single_worker));
+    const size_t pooled_count = pooled_server.GetQueryExecutor()->Async([&pooled_server, &queries] {
+        auto results = ProcessQueriesJoined(pooled_server, queries);
+        return static_cast<size_t>(std::distance(results.begin(), results.end()));
+    }).get();
+    ASSERT_EQUAL(pooled_count, expected.size());
+
+    // Чтение можно прервать, незавершенные пакеты дожидаются в деструкторе
+    {
+        auto results = ProcessQueriesJoined(search_server, queries);
+        ASSERT_EQUAL(results.begin()->id, expected.front().id);
+    }
+
+    const std::vector<std::string> no_queries;
+    ASSERT(ProcessQueriesJoined(search_server, no_queries).begin() == JoinedQueryResults::Iterator());
+    const std::vector<std::string> bad_queries = { dictionary[1], "--"s + dictionary[1] };
+    auto bad_results = ProcessQueriesJoined(search_server, bad_queries);
+    try {
+        bad_results.begin();
+        ASSERT_HINT(false, "Invalid query must throw"s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+// Пул потоков выполняет вложенные задачи и ограничивает очередь
+void TestQueryExecutor() {
+    QueryExecutorOptions options;
+    options.worker_count = 2;
+    options.max_queued_tasks = 2;
+    QueryExecutor executor(options);
+    ASSERT_EQUAL(executor.GetWorkerCount(), 2u);
+
+    // Вложенные ParallelFor не ждут сами себя, каждый индекс вызывается один раз
+    std::vector<std::atomic<int>> calls(100);
+    executor.ParallelFor(10, [&](size_t outer) {
+        executor.ParallelFor(10, [&](size_t inner) {
+            ++calls[outer * 10 + inner];
+        });
+    });
+    ASSERT(std::all_of(calls.begin(), calls.end(), [](const std::atomic<int>& count) {
+        return count == 1;
+    }));
+    try {
+        executor.ParallelFor(5, [](size_t index) {
+            if (index == 3) {
+                throw std::out_of_range("3"s);
+            }
+        });
+        ASSERT_HINT(false, "ParallelFor must rethrow"s);
+    } catch (const std::out_of_range&) {
+    }
+
+    ASSERT_EQUAL(executor.Async([] {
+        return 42;
+    }).get(), 42);
+    auto failed = executor.Async([]() -> int {
+        throw std::invalid_argument("failed"s);
+    });
+    try {
+        failed.get();
+        ASSERT_HINT(false, "Async must pass the exception"s);
+    } catch (const std::invalid_argument&) {
+    }
+
+    // Пока оба потока заняты, в очередь помещается только max_queued_tasks задач
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<int> started = 0;
+    for (int i = 0; i < 2; ++i) {
+        executor.Submit([&started, released] {
+            ++started;
+            released.wait();
+        });
+    }
+    while (started < 2) {
+        std::this_thread::yield();
+    }
+    std::atomic<int> finished = 0;
+    ASSERT(executor.TrySubmit([&finished] {
+        ++finished;
+    }));
+    ASSERT(executor.TrySubmit([&finished] {
+        ++finished;
+    }));
+    ASSERT(!executor.TrySubmit([&finished] {
+        ++finished;
+    }));
+    ASSERT_EQUAL(executor.GetQueuedTaskCount(), 2u);
+    // Поток вне пула выполняет части своего ParallelFor, но не чужие задачи из очереди
+    std::vector<std::thread::id> part_threads(4);
+    executor.ParallelFor(part_threads.size(), [&part_threads](size_t index) {
+        part_threads[index] = std::this_thread::get_id();
+    });
+    ASSERT(std::all_of(part_threads.begin(), part_threads.end(), [](std::thread::id id) {
+        return id == std::this_thread::get_id();
+    }));
+    ASSERT_EQUAL(finished.load(), 0);
+    release.set_value();
+    while (finished < 2) {
+        std::this_thread::yield();
+    }
+
+    // Поисковая система выполняет параллельные запросы в заданном пуле
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black cat"sv, DocumentStatus::ACTUAL, { 2 });
+    auto executor_ptr = std::make_shared<QueryExecutor>(options);
+    search_server.SetQueryExecutor(executor_ptr);
+    ASSERT(search_server.GetQueryExecutor() == executor_ptr);
+    ASSERT(SearchServer(search_server).GetQueryExecutor() == executor_ptr);
+    ASSERT_EQUAL(search_server.FindTopDocuments(std::execution::par, "cat"sv).size(), 2u);
+    ASSERT_EQUAL(ProcessQueries(search_server, { "white"s, "black cat"s }).size(), 2u);
+
+    // Задача может держать последнюю ссылку на пул
+    auto owned = std::make_shared<QueryExecutor>(options);
+    std::promise<void> release_owner;
+    auto owner_finished = owned->Async([owner = owned, released = release_owner.get_future()] {
+        released.wait();
+    });
+    owned.reset();
+    release_owner.set_value();
+    owner_finished.get();
+}
+
+// Асинхронный поиск, отмена и срок выполнения запроса
+void TestFindTopDocumentsAsync() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black cat"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "black dog"sv, DocumentStatus::BANNED, { 3 });
+    QueryExecutorOptions executor_options;
+    executor_options.worker_count = 1;
+    search_server.SetQueryExecutor(std::make_shared<QueryExecutor>(executor_options));
+
+    std::string query = "black cat"s;
+    auto found = search_server.FindTopDocumentsAsync(query);
+    // Текст запроса скопирован
+    query = "white"s;
+    ASSERT_EQUAL(found.get().size(), 2u);
+    ASSERT_EQUAL(search_server.FindTopDocumentsAsync("dog"sv, DocumentStatus::BANNED).get().front().id, 3);
+
+    std::promise<std::vector<Document>> callback_result;
+    search_server.FindTopDocumentsAsync("white cat"sv, DocumentStatus::ACTUAL, {},
+        [&callback_result](std::vector<Document> documents, std::exception_ptr error) {
+            if (error) {
+                callback_result.set_exception(error);
+            } else {
+                callback_result.set_value(std::move(documents));
+            }
+        });
+    ASSERT_EQUAL(callback_result.get_future().get().front().id, 1);
+
+    const auto assert_cancelled = [](std::future<std::vector<Document>>& result) {
+        try {
+            result.get();
+            ASSERT_HINT(false, "Query must be cancelled"s);
+        } catch (const QueryCancelled&) {
+        }
+    };
+
+    // Запрос, отмененный в очереди, не выполняется
+    std::promise<void> release;
+    search_server.GetQueryExecutor()->Submit([released = release.get_future().share()] {
+        released.wait();
+    });
+    SearchOptions options;
+    options.cancellation = std::make_shared<QueryCancellation>();
+    auto cancelled = search_server.FindTopDocumentsAsync("cat"sv, DocumentStatus::ACTUAL, options);
+    options.cancellation->Cancel();
+    release.set_value();
+    assert_cancelled(cancelled);
+
+    // Просроченный запрос прерывается и в синхронном поиске
+    SearchOptions expired;
+    expired.deadline = std::chrono::steady_clock::now();
+    auto late = search_server.FindTopDocumentsAsync("cat"sv, DocumentStatus::ACTUAL, expired);
+    assert_cancelled(late);
+    try {
+        search_server.FindTopDocuments("cat"sv, DocumentStatus::ACTUAL, expired);
+        ASSERT_HINT(false, "Expired query must throw"s);
+    } catch (const QueryCancelled&) {
+    }
+    try {
+        search_server.FindTopDocumentsBatch({ "cat"sv }, DocumentStatus::ACTUAL, expired);
+        ASSERT_HINT(false, "Expired batch must throw"s);
+    } catch (const QueryCancelled&) {
+    }
+    SearchOptions in_time;
+    in_time.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    ASSERT_EQUAL(search_server.FindTopDocuments(std::execution::par, "cat"sv, DocumentStatus::ACTUAL, in_time).size(), 2u);
+
+    // Асинхронный запрос к ConcurrentSearchServer видит версию на момент вызова
+    ConcurrentSearchServer concurrent_server(search_server);
+    auto concurrent_found = concurrent_server.FindTopDocumentsAsync("cat"sv);
+    concurrent_server.RemoveDocument(1);
+    ASSERT_EQUAL(concurrent_found.get().size(), 2u);
+    ASSERT_EQUAL(concurrent_server.FindTopDocumentsAsync("cat"sv).get().size(), 1u);
+}
+
+// Кэш результатов запросов и его сброс при изменениях
+void TestQueryResultCache() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black cat"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "black dog"sv, DocumentStatus::BANNED, { 3 });
+    QueryResultCacheOptions cache_options;
+    cache_options.capacity = 4;
+    cache_options.shard_count = 1;
+    auto cache = std::make_shared<QueryResultCache>(cache_options);
+    search_server.SetResultCache(cache);
+
+    const auto expected = search_server.FindTopDocuments("black cat -white"sv);
+    ASSERT_EQUAL(cache->GetStats().misses, 1u);
+    // Тот же запрос после нормализации
+    const auto cached = search_server.FindTopDocuments(std::execution::par, "cat and -white black black"sv);
+    ASSERT_EQUAL(cache->GetStats().hits, 1u);
+    ASSERT_EQUAL(cached.size(), expected.size());
+    ASSERT_EQUAL(cached.front().id, expected.front().id);
+    ASSERT_EQUAL(cached.front().relevance, expected.front().relevance);
+
+    // Статус и число результатов входят в ключ, запросы с предикатом не кэшируются
+    ASSERT_EQUAL(search_server.FindTopDocuments("black"sv, DocumentStatus::BANNED).front().id, 3);
+    SearchOptions one_result;
+    one_result.max_result_count = 1;
+    ASSERT_EQUAL(search_server.FindTopDocuments("black cat -white"sv, DocumentStatus::ACTUAL, one_result).size(), 1u);
+    search_server.FindTopDocuments("cat"sv, [](int, DocumentStatus, int) {
+        return true;
+    });
+    ASSERT_EQUAL(cache->GetStats().misses, 3u);
+    ASSERT_EQUAL(cache->GetStats().size, 3u);
+
+    // Изменения делают прежние результаты недействительными
+    search_server.AddDocument(4, "black cat black"sv, DocumentStatus::ACTUAL, { 4 });
+    ASSERT_EQUAL(search_server.FindTopDocuments("black cat -white"sv).front().id, 4);
+    ASSERT_EQUAL(cache->GetStats().invalidations, 1u);
+    search_server.RemoveDocument(4);
+    ASSERT_EQUAL(search_server.FindTopDocuments("black cat -white"sv).front().id, 2);
+    ASSERT_EQUAL(cache->GetStats().invalidations, 2u);
+
+    // Копии делят кэш, пока одна из них не изменится
+    SearchServer copy(search_server);
+    copy.FindTopDocuments("black cat -white"sv);
+    ASSERT_EQUAL(cache->GetStats().hits, 2u);
+    copy.AddDocument(5, "black cat cat"sv, DocumentStatus::ACTUAL, { 5 });
+    ASSERT_EQUAL(copy.FindTopDocuments("black cat -white"sv).front().id, 5);
+    ASSERT_EQUAL(search_server.FindTopDocuments("black cat -white"sv).front().id, 2);
+
+    for (const std::string_view query : { "white"sv, "dog"sv, "black"sv, "cat"sv }) {
+        search_server.FindTopDocuments(query);
+    }
+    const auto stats = cache->GetStats();
+    ASSERT_EQUAL(stats.size, 4u);
+    ASSERT(stats.evictions > 0);
+
+    // Результат, посчитанный на более старом поколении, не вытесняет более новый
+    QueryResultCache ordered_cache(cache_options);
+    ordered_cache.Insert("query"s, 11, { Document(1, 0.5, 1) });
+    ordered_cache.Insert("query"s, 10, { Document(2, 0.25, 2) });
+    const auto newer = ordered_cache.Find("query"s, 11);
+    ASSERT(newer.has_value());
+    ASSERT_EQUAL(newer->front().id, 1);
+}
+
+// Гистограммы задержек и счетчики этапов
+void TestMetrics() {
+    for (const uint64_t value : { 0ull, 31ull, 32ull, 1'000ull, 123'456'789ull }) {
+        const uint64_t bucket_max = LatencyHistogram::GetBucketMax(LatencyHistogram::GetBucket(value));
+        ASSERT(bucket_max >= value);
+        ASSERT(bucket_max - value <= value / 32);
+    }
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1'000; ++value) {
+        histogram.Add(value);
+    }
+    ASSERT_EQUAL(histogram.GetCount(), 1'000u);
+    ASSERT_EQUAL(histogram.GetMax(), 1'000u);
+    ASSERT(histogram.GetPercentile(0.5) >= 500 && histogram.GetPercentile(0.5) <= 500 + 500 / 32);
+    ASSERT(histogram.GetPercentile(0.99) >= 990 && histogram.GetPercentile(0.99) <= 1'000);
+    ASSERT_EQUAL(histogram.GetPercentile(1.0), 1'000u);
+
+#ifndef SEARCH_SERVER_DISABLE_METRICS
+    ResetMetrics();
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocuments({ { 2, "black cat"sv, DocumentStatus::ACTUAL, { 2 } },
+        { 3, "black dog"sv, DocumentStatus::ACTUAL, { 3 } } });
+    search_server.RemoveDocument(3);
+    for (int i = 0; i < 10; ++i) {
+        search_server.FindTopDocuments("black cat -white"sv);
+    }
+    search_server.FindTopDocumentsBatch({ "cat"sv, "dog"sv });
+
+    const auto snapshot = GetMetricsSnapshot();
+    ASSERT_EQUAL(snapshot.Get(MetricCounter::QUERIES), 12u);
+    ASSERT_EQUAL(snapshot.Get(MetricCounter::ADDED_DOCUMENTS), 3u);
+    ASSERT_EQUAL(snapshot.Get(MetricCounter::REMOVED_DOCUMENTS), 1u);
+    ASSERT_EQUAL(snapshot.Get(MetricCounter::MATCHED_DOCUMENTS), 10u);
+    ASSERT_EQUAL(snapshot.Get(MetricStage::QUERY_PARSE).GetCount(), 12u);
+    ASSERT_EQUAL(snapshot.Get(MetricStage::QUERY_SEARCH).GetCount(), 10u);
+    ASSERT_EQUAL(snapshot.Get(MetricStage::QUERY_BATCH).GetCount(), 1u);
+    ASSERT_EQUAL(snapshot.Get(MetricStage::INGEST_TOKENIZE).GetCount(), 3u);
+    ASSERT_EQUAL(snapshot.Get(MetricStage::INGEST_BATCH).GetCount(), 1u);
+    const auto& search = snapshot.Get(MetricStage::QUERY_SEARCH);
+    ASSERT(search.GetPercentile(0.5) <= search.GetPercentile(0.999));
+    ASSERT(search.GetPercentile(0.999) <= search.GetMax());
+
+    std::ostringstream out;
+    PrintMetrics(out, snapshot);
+    ASSERT(out.str().find("query_search\t10\t"s) != std::string::npos);
+    ASSERT(out.str().find("removed_documents\t1\n"s) != std::string::npos);
+
+    ResetMetrics();
+    ASSERT_EQUAL(GetMetricsSnapshot().Get(MetricCounter::QUERIES), 0u);
+#endif
+}
+
+// Синтетический корпус, дубликаты, журнал запросов и запись в файл
+void TestCorpusGenerator() {
+    // Слова состоят только из строчных латинских букв
+    std::mt19937 generator;
+    for (const std::string& word : Generator::GenerateDictionary(generator, 1'000, 8)) {
+        ASSERT(std::all_of(word.begin(), word.end(), [](char c) {
+            return c >= 'a' && c <= 'z';
+        }));
+    }
+
+    Generator::CorpusOptions options;
+    options.vocabulary_size = 500;
+    options.median_document_words = 20;
+    options.max_document_words = 50;
+    options.duplicate_share = 0.2;
+    options.banned_share = 0.3;
+    Generator::CorpusGenerator corpus(options);
+    const auto& dictionary = corpus.GetDictionary();
+    ASSERT_EQUAL(std::set<std::string>(dictionary.begin(), dictionary.end()).size(), 500u);
+    const auto documents = corpus.Generate(2'000);
+
+    // Частоты слов убывают по закону Ципфа, длина документов ограничена
+    std::map<std::string_view, int> word_counts;
+    int banned_count = 0;
+    int duplicate_count = 0;
+    for (int i = 0; i < static_cast<int>(documents.size()); ++i) {
+        const auto& document = documents[i];
+        ASSERT_EQUAL(document.id, i);
+        const auto words = SplitIntoWords(document.text);
+        ASSERT(!words.empty() && words.size() <= 50u);
+        for (const std::string_view word : words) {
+            ++word_counts[word];
+        }
+        banned_count += document.status == DocumentStatus::BANNED;
+        duplicate_count += document.is_duplicate;
+    }
+    ASSERT(word_counts[dictionary.front()] > 10 * word_counts[dictionary.back()]);
+    ASSERT(banned_count > 450 && banned_count < 750);
+    ASSERT(duplicate_count > 300 && duplicate_count < 500);
+
+    // RemoveDuplicates удаляет ровно вставленные дубликаты
+    SearchServer search_server(""s);
+    for (const auto& document : documents) {
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    std::ostringstream removed;
+    RemoveDuplicates(search_server, removed);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), static_cast<int>(documents.size()) - duplicate_count);
+
+    // Те же параметры дают тот же корпус
+    Generator::CorpusGenerator same_corpus(options);
+    ASSERT_EQUAL(same_corpus.GetDictionary(), dictionary);
+    ASSERT_EQUAL(same_corpus.Next().text, documents.front().text);
+
+    // Горячие запросы журнала повторяются
+    Generator::QueryLogOptions log_options;
+    log_options.distinct_queries = 100;
+    log_options.minus_prob = 0.2;
+    const auto query_log = Generator::GenerateQueryLog(corpus, log_options, 1'000);
+    std::map<std::string, int> query_counts;
+    for (const std::string& query : query_log) {
+        ++query_counts[query];
+        ASSERT(!SplitIntoWords(query).empty() && SplitIntoWords(query).size() <= 4u);
+    }
+    ASSERT(query_counts.size() <= 100u);
+    ASSERT(std::max_element(query_counts.begin(), query_counts.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second < rhs.second;
+    })->second > 100);
+
+    // Корпус и журнал записываются построчно и читаются обратно
+    Generator::CorpusGenerator written_corpus(options);
+    std::stringstream corpus_stream;
+    Generator::WriteCorpus(written_corpus, 100, corpus_stream);
+    Generator::GeneratedDocument document;
+    for (size_t i = 0; i < 100; ++i) {
+        ASSERT(Generator::ReadDocument(corpus_stream, document));
+        ASSERT_EQUAL(document.id, documents[i].id);
+        ASSERT_EQUAL(document.text, documents[i].text);
+        ASSERT(document.status == documents[i].status);
+        ASSERT_EQUAL(document.ratings, documents[i].ratings);
+    }
+    ASSERT(!Generator::ReadDocument(corpus_stream, document));
+    std::stringstream log_stream;
+    Generator::WriteQueryLog(corpus, log_options, query_log.size(), log_stream);
+    for (const std::string& query : query_log) {
+        std::string line;
+        ASSERT(std::getline(log_stream, line));
+        ASSERT_EQUAL(line, query);
+    }
+    std::istringstream invalid("1\tbanned\t1\tcat\n"s);
+    try {
+        Generator::ReadDocument(invalid, document);
+        ASSERT_HINT(false, "Invalid status must throw"s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+// Разбор на слова всеми реализациями токенизатора
+void TestSplitIntoWords() {
+    std::vector<std::string_view> words = { "stale"sv };
+    ASSERT(SplitIntoWords("  white  cat "sv, words));
+    ASSERT_EQUAL(words, std::vector<std::string_view>({ "white"sv, "cat"sv }));
+    ASSERT(SplitIntoWords(""sv, words));
+    ASSERT(words.empty());
+
+    // Случайные тексты с длинами вокруг границ блоков, управляющими символами и байтами от 128
+    std::mt19937 generator;
+    const std::string alphabet = "  ab\x80\xff\t\x1f"s;
+    std::vector<std::string_view> expected;
+    std::vector<std::string_view> actual;
+    for (int i = 0; i < 2'000; ++i) {
+        std::string text(std::uniform_int_distribution(0, 200)(generator), ' ');
+        const bool with_control = i % 2 == 0;
+        for (char& c : text) {
+            c = alphabet[std::uniform_int_distribution<size_t>(0, with_control ? alphabet.size() - 1 : 5)(generator)];
+        }
+        expected.clear();
+        bool expected_valid = true;
+        for (size_t begin = 0, end = 0; begin < text.size(); begin = end + 1) {
+            end = std::min(text.find(' ', begin), text.size());
+            if (end > begin) {
+                expected.emplace_back(text.data() + begin, end - begin);
+            }
+        }
+        for (const char c : text) {
+            expected_valid &= !(c >= '\0' && c < ' ');
+        }
+        for (const auto tokenizer : { Tokenizer::SCALAR, Tokenizer::SSE2, Tokenizer::AVX2 }) {
+            if (!IsTokenizerSupported(tokenizer)) {
+                continue;
+            }
+            ASSERT_EQUAL(SplitIntoWords(tokenizer, text, actual), expected_valid);
+            ASSERT_EQUAL(actual, expected);
+        }
+    }
+
+    // Слово с управляющим символом отклоняется при добавлении документа
+    SearchServer search_server("and"s);
+    try {
+        search_server.AddDocument(1, "white and c\x01t"sv, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "Control characters must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+    search_server.AddDocument(1, "white and  cat"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 2u);
+}
+
+// Подготовленный запрос и разбор запросов
+void TestPreparedQuery() {
+    SearchServer search_server("and in"s);
+    search_server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "groomed dog expressive eyes"sv, DocumentStatus::ACTUAL, { 3 });
+    const auto assert_same = [](const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+        ASSERT_EQUAL(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+            ASSERT_EQUAL(lhs[i].relevance, rhs[i].relevance);
+        }
+    };
+
+    // Подготовленный запрос дает те же результаты, что и текст запроса
+    const std::string text = "fluffy groomed cat -collar in parrot cat"s;
+    const auto prepared = search_server.PrepareQuery(text);
+    ASSERT_EQUAL(prepared.GetText(), text);
+    const auto expected = search_server.FindTopDocuments(text);
+    ASSERT_EQUAL(expected.size(), 2u);
+    assert_same(search_server.FindTopDocuments(prepared), expected);
+    assert_same(search_server.FindTopDocuments(prepared), expected);
+    assert_same(search_server.FindTopDocuments(std::execution::par, prepared), expected);
+    assert_same(search_server.FindTopDocuments(prepared, DocumentStatus::BANNED), {});
+    assert_same(SearchServer(search_server).FindTopDocuments(prepared), expected);
+
+    // Слово, которого не было при подготовке, находится после добавления документа
+    search_server.AddDocument(4, "parrot"sv, DocumentStatus::ACTUAL, { 4 });
+    const auto found = search_server.FindTopDocuments(prepared);
+    ASSERT(std::any_of(found.begin(), found.end(), [](const Document& document) {
+        return document.id == 4;
+    }));
+    assert_same(found, search_server.FindTopDocuments(text));
+    search_server.AddDocument(5, "parrot with a collar"sv, DocumentStatus::ACTUAL, { 5 });
+    assert_same(search_server.FindTopDocuments(prepared), search_server.FindTopDocuments(text));
+
+    // На поисковой системе с другим словарем запрос разбирается заново
+    SearchServer other_server("and"s);
+    other_server.AddDocument(1, "parrot in a cage"sv, DocumentStatus::ACTUAL, { 1 });
+    other_server.AddDocument(2, "groomed cat"sv, DocumentStatus::ACTUAL, { 2 });
+    other_server.AddDocument(3, "fluffy collar"sv, DocumentStatus::ACTUAL, { 3 });
+    assert_same(other_server.FindTopDocuments(prepared), other_server.FindTopDocuments(text));
+    ASSERT_EQUAL(other_server.FindTopDocuments(prepared).size(), 2u);
+
+    // Ошибки запроса обнаруживаются при подготовке
+    for (const std::string_view invalid : { "cat --dog"sv, "cat -"sv, "c\x01t"sv }) {
+        try {
+            search_server.PrepareQuery(invalid);
+            ASSERT_HINT(false, "Invalid query must throw"s);
+        } catch (const std::invalid_argument&) {
+        }
+    }
+
+    // Поиск внутри предиката другого поиска разбирает свой запрос отдельно
+    const auto nested = search_server.FindTopDocuments("cat"sv, [&search_server](int, DocumentStatus, int) {
+        return search_server.FindTopDocuments("dog"sv).size() == 1;
+    });
+    ASSERT_EQUAL(nested.size(), 2u);
+
+    // Повторы слов не влияют на результат сопоставления, слова идут по алфавиту
+    const auto [words, status] = search_server.MatchDocument("fluffy cat cat -dog tail"sv, 2);
+    ASSERT_EQUAL(words, std::vector<std::string_view>({ "cat"sv, "fluffy"sv, "tail"sv }));
+    ASSERT(std::get<0>(search_server.MatchDocument(std::execution::par, "cat -fluffy"sv, 2)).empty());
+}
+
 // Функция TestSearchServer является точкой входа для запуска тестов
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
@@ -232,19 +1757,31 @@ void TestSearchServer() {
     RUN_TEST(TestSortAndComputingRelevanceRatingDocuments);
     RUN_TEST(TestFindDocumentStatus);
     RUN_TEST(TestPredicateFunc);
+    RUN_TEST(TestTermDictionary);
+    RUN_TEST(TestRemoveDocument);
+    RUN_TEST(TestScoreAccumulator);
+    RUN_TEST(TestParallelSearchMatchesSequential);
+    RUN_TEST(TestSearchOptionsResultCount);
+    RUN_TEST(TestInverseDocumentFreqCache);
+    RUN_TEST(TestMaxScoreMatchesExhaustive);
+    RUN_TEST(TestCompressedPostings);
+    RUN_TEST(TestExclusionSet);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestSnapshot);
+    RUN_TEST(TestMutationLog);
+    RUN_TEST(TestConcurrentSearchServer);
+    RUN_TEST(TestVersionsShareState);
+    RUN_TEST(TestSegmentedIndex);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestFindTopDocumentsBatch);
+    RUN_TEST(TestProcessQueriesJoined);
+    RUN_TEST(TestQueryExecutor);
+    RUN_TEST(TestFindTopDocumentsAsync);
+    RUN_TEST(TestQueryResultCache);
+    RUN_TEST(TestMetrics);
+    RUN_TEST(TestCorpusGenerator);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestPreparedQuery);
 }
 
 // --------- Окончание модульных тестов поисковой системы -----------
-
-void Benchmark() {
-    std::mt19937 generator;
-    const auto dictionary = Generator::GenerateDictionary(generator, 1000, 10);
-    const auto documents = Generator::GenerateQueries(generator, dictionary, 10'000, 70);
-    SearchServer search_server(dictionary[0]);
-    for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
-    }
-    const auto queries = Generator::GenerateQueries(generator, dictionary, 100, 70);
-    TEST(seq);
-    TEST(par);
-}
\ No newline at end of file
@@ -94,20 +94,6 @@ void AssertImpl(bool value, std::string_view expr_str, std::string_view file, st
 
 #define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
 
-template <typename ExecutionPolicy>
-void Test(std::string_view mark, const SearchServer& search_server, const std::vector<std::string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
-    double total_relevance = 0;
-    for (const std::string_view query : queries) {
-        for (const auto& document : search_server.FindTopDocuments(policy, query)) {
-            total_relevance += document.relevance;
-        }
-    }
-    std::cout << total_relevance << std::endl;
-}
-
-#define TEST(policy) Test(#policy, search_server, queries, std::execution::policy)
-
 // -------- Начало модульных тестов поисковой системы ----------
 // Тест проверяет, что поисковая система исключает стоп-слова при добавлении документов
 void TestExcludeStopWordsFromAddedDocumentContent();
@@ -121,10 +107,57 @@ void TestSortAndComputingRelevanceRatingDocuments();
 void TestFindDocumentStatus();
 // Тест использования предиката, задаваемого пользователем
 void TestPredicateFunc();
+// Словарь уникальных слов документов
+void TestTermDictionary();
+// Удаление документов
+void TestRemoveDocument();
+// Накопитель релевантности
+void TestScoreAccumulator();
+// Сравнение параллельного и последовательного поиска
+void TestParallelSearchMatchesSequential();
+// Количество результатов поиска
+void TestSearchOptionsResultCount();
+// Кеш IDF
+void TestInverseDocumentFreqCache();
+// Вычисление запроса методом MaxScore
+void TestMaxScoreMatchesExhaustive();
+// Сжатые списки документов
+void TestCompressedPostings();
+// Исключение документов минус-словами
+void TestExclusionSet();
+// Пакетное добавление документов
+void TestAddDocuments();
+// Сохранение и загрузка снимка
+void TestSnapshot();
+// Журнал изменений
+void TestMutationLog();
+// Копирование поисковой системы и запросы одновременно с изменениями
+void TestConcurrentSearchServer();
+// Общие для версий словарь и данные документов
+void TestVersionsShareState();
+// Сегменты индекса и их слияние
+void TestSegmentedIndex();
+// Пакетное удаление документов и очистка сегментов
+void TestRemoveDocuments();
+// Пакетный поиск
+void TestFindTopDocumentsBatch();
+// Потоковое чтение результатов запросов
+void TestProcessQueriesJoined();
+// Пул потоков для запросов
+void TestQueryExecutor();
+// Асинхронный поиск с отменой и сроком выполнения
+void TestFindTopDocumentsAsync();
+// Кэш результатов запросов
+void TestQueryResultCache();
+// Измерение этапов поиска и индексации
+void TestMetrics();
+// Синтетический корпус документов и журнал запросов
+void TestCorpusGenerator();
+// Разбор текста на слова
+void TestSplitIntoWords();
+// Подготовленные запросы
+void TestPreparedQuery();
 // Функция TestSearchServer является точкой входа для запуска тестов
 void TestSearchServer();
 // --------- Окончание модульных тестов поисковой системы -----------
 
-// --------------------------- Benchmarks ---------------------------
-void Benchmark();
-// ------------------------- End Benchmarks -------------------------